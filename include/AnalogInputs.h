@@ -0,0 +1,36 @@
+#ifndef ANALOG_INPUTS_H
+#define ANALOG_INPUTS_H
+
+#include <Arduino.h>
+
+//================================
+// ANALOG INPUTS
+//================================
+
+// Optional background sampling of the analog-only pins A6 and A7, built
+// with -DANALOG_INPUT. The ADC runs free and its conversion-complete ISR
+// sums ANALOG_OVERSAMPLE readings per channel before switching to the other
+// one. The loop turns each sum into a 12-bit value, smooths it and only
+// reports it when it moved at least ANALOG_HYSTERESIS away from the last
+// reported value, so a pot or footswitch costs nothing on the bus at rest.
+
+#define ANALOG_CHANNELS 2
+#define ANALOG_OVERSAMPLE 16    // 16 x 10-bit readings = one 12-bit value
+#define ANALOG_FILTER_SHIFT 2   // Each new value moves the output 1/4 of the way
+#define ANALOG_HYSTERESIS 8     // 12-bit counts, about 0.2% of full scale
+
+void setupAnalogInputs();
+
+// Filter new values from the ISR, call once per loop
+void updateAnalogInputs();
+
+// True if a value changed since the last analog frame
+bool analogChangePending();
+
+// Last reported value of a channel (0 = A6)
+uint16_t getAnalogValue(uint8_t channel);
+
+// Called once the values went out in a frame
+void clearAnalogChange();
+
+#endif // ANALOG_INPUTS_H
@@ -0,0 +1,34 @@
+#ifndef AUTO_REPEAT_H
+#define AUTO_REPEAT_H
+
+#include <Arduino.h>
+#include "KeyboardConfig.h"
+
+//================================
+// AUTO-REPEAT
+//================================
+
+// Only the most recently pressed repeat-enabled key repeats, like a PC
+// keyboard. Repeats are queued as KEY_EVENT_REPEAT for that key.
+
+#define REPEAT_DELAY_MS 500         // Default hold time before the first repeat
+#define REPEAT_INTERVAL_MS 50       // Default time between repeats (20 per second)
+#define REPEAT_TIME_MAX_MS 0x7FFF   // Due ticks are compared as signed 16-bit differences
+
+extern uint16_t repeatMask[MATRIX_ROWS];   // 1 = key auto-repeats while held
+extern uint16_t repeatDelay;
+extern uint16_t repeatInterval;
+
+// Restore the default timing and disable all keys
+void setupAutoRepeat();
+
+// Called for every queued press and every release
+void trackRepeatKey(uint8_t keyIndex, bool keyPressed);
+
+// Set the timing, clamped to what the due tick compare can handle
+void setRepeatTiming(uint16_t delayMs, uint16_t intervalMs);
+
+// Queue a repeat when one is due, call once per scan
+void updateAutoRepeat();
+
+#endif // AUTO_REPEAT_H
@@ -0,0 +1,34 @@
+#ifndef CHORDS_H
+#define CHORDS_H
+
+#include <Arduino.h>
+#include "KeyboardConfig.h"
+
+//================================
+// CHORD DETECTION
+//================================
+
+// Chord keys pressed within the chord window are reported as one chord
+// event carrying the set of keys, instead of separate presses. A single
+// chord key pressed on its own is sent as a normal press once the window
+// closes.
+
+#define CHORD_MASK_BYTES ((MATRIX_KEYS + 7) / 8)   // Bit n = matrix index n
+#define CHORD_SLOTS 24     // Key sets kept, enough for every record queued or in the history
+
+extern uint16_t chordMask[MATRIX_ROWS];   // 1 = key can be part of a chord
+extern uint8_t chordWindow;               // ms, 0 = chord detection off
+
+void setupChords();
+
+// Feed a debounced edge, returns true if the edge should continue to the
+// later stages (gestures, event queue)
+bool chordKeyEdge(uint8_t keyIndex, bool keyPressed);
+
+// Close the chord window once it has expired, call once per scan
+void updateChords();
+
+// Key set of the chord stored in a slot (the keyIndex of a chord event)
+void getChordKeys(uint8_t slot, uint8_t* keys);
+
+#endif // CHORDS_H
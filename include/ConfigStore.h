@@ -0,0 +1,63 @@
+#ifndef CONFIG_STORE_H
+#define CONFIG_STORE_H
+
+#include <Arduino.h>
+
+//================================
+// CONFIG STORE
+//================================
+
+// Persists a fixed list of RAM regions (settings, masks, keymap) as one
+// record in an EEPROM area. The area is split into as many record slots as
+// fit and every save goes to the slot after the newest one, so writes are
+// spread over the whole area and the last good record is never touched
+// while a new one is written. Each record carries a sequence number and a
+// CRC; on boot the newest valid record wins.
+//
+// Saves run in the background one byte at a time whenever the EEPROM is
+// idle, the loop never waits for a write to finish. The header is written
+// last, so a reset or brown-out halfway leaves the previous record in use.
+// Several stores can share the EEPROM, each in its own area.
+
+struct ConfigRegion {
+  void* data;
+  uint16_t size;
+};
+
+struct ConfigStore {
+  const ConfigRegion* regions;   // In PROGMEM
+  uint8_t regionCount;
+  uint16_t base;                 // EEPROM area
+  uint16_t payloadSize;
+  uint16_t slotSize;
+  uint8_t slotCount;
+  
+  uint8_t newestSlot;            // 0xFF = no valid record yet
+  uint16_t newestSequence;
+  
+  uint8_t saveStep;
+  bool saveRequested;
+  uint8_t saveSlot;
+  uint16_t saveSequence;
+  uint16_t savePosition;         // Offset of the next byte after the magic
+  uint16_t saveCrc;
+};
+
+// Register the regions that make up a record (table in PROGMEM) and the
+// EEPROM area holding the slots. Changing the table changes the record
+// size, older records are then ignored.
+void setupConfigStore(ConfigStore* store, const ConfigRegion* regions, uint8_t count,
+                      uint16_t base, uint16_t size);
+
+// Copy the newest valid record into the regions, returns false (regions
+// untouched) if there is none
+bool loadConfig(ConfigStore* store);
+
+// Ask for the regions to be saved, a save already running is finished and
+// followed by another one
+void saveConfig(ConfigStore* store);
+
+// Write at most one byte of a pending save, call once per loop
+void updateConfigStore(ConfigStore* store);
+
+#endif // CONFIG_STORE_H
@@ -0,0 +1,45 @@
+#ifndef DEBOUNCE_H
+#define DEBOUNCE_H
+
+#include <Arduino.h>
+#include "KeyboardConfig.h"
+
+//================================
+// DEBOUNCE TUNING
+//================================
+
+// Every key has its own lockout window after an accepted change. Level
+// changes seen while a key is locked out are bounce, the latest one marks
+// how long that key bounced. When the window ends it is raised at once to
+// twice that plus a margin if it was too short, and lowered by 1ms after
+// DEBOUNCE_DECAY_EDGES edges in a row that would have fitted a shorter
+// window. Windows stay within the master-set bounds, equal bounds turn
+// tuning off.
+
+#define DEBOUNCE_MIN_MS 3          // Default lower bound
+#define DEBOUNCE_TUNE_MARGIN_MS 3  // Covers the scan interval the bounce is sampled at
+#define DEBOUNCE_DECAY_EDGES 16
+
+extern uint8_t debounceWindow[MATRIX_KEYS];   // Current window per key (ms)
+extern uint8_t debounceMin;
+extern uint8_t debounceMax;
+
+// All windows start at the upper bound
+void setupDebounce(uint8_t maxWindow);
+
+// New bounds, windows outside them are clamped
+void setDebounceBounds(uint8_t minWindow, uint8_t maxWindow);
+
+// A key starts its lockout
+void debounceEdge(uint8_t keyIndex);
+
+// The key's level differed from its debounced state this long (ms) into the lockout
+void debounceBounce(uint8_t keyIndex, uint8_t sinceEdge);
+
+// The lockout is over, adjust the window from the bounce seen
+void debounceSettled(uint8_t keyIndex);
+
+// True once after any window changed, to save the tuning
+bool takeDebounceTuningChanged();
+
+#endif // DEBOUNCE_H
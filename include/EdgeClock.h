@@ -0,0 +1,21 @@
+#ifndef EDGE_CLOCK_H
+#define EDGE_CLOCK_H
+
+#include <Arduino.h>
+
+//================================
+// EDGE CLOCK
+//================================
+
+// Timer1 free running at 8MHz / 8, one count per microsecond. Its overflow
+// interrupt (every 65.5ms) counts the upper 16 bits, so the clock is a full
+// 32-bit microsecond time. Unlike millis() it never skips a value.
+//
+// Takes Timer1 over, analogWrite() on D9/D10 no longer works.
+
+void setupEdgeClock();
+
+// Full 32-bit clock in us, safe to call with interrupts disabled
+uint32_t edgeClockMicros();
+
+#endif // EDGE_CLOCK_H
@@ -0,0 +1,26 @@
+#ifndef ENCODER_H
+#define ENCODER_H
+
+#include <Arduino.h>
+
+//================================
+// ROTARY ENCODER
+//================================
+
+// Optional quadrature encoder on the spare pins D10 (A) and D13 (B), built
+// with -DENCODER_INPUT. Every edge on either pin runs a pin-change interrupt
+// that looks up the step in a 16-entry transition table, invalid
+// transitions (both channels changed) count as no step. Whole detents are
+// taken from the count by the loop and queued as KEY_EVENT_ENCODER.
+//
+// D13 also drives the on-board LED, whose load is stronger than the
+// internal pull-up, so that channel needs an external pull-up (~1k).
+
+#define ENCODER_STEPS_PER_DETENT 4   // Quadrature steps per click, 4 for most encoders
+
+void setupEncoder();
+
+// Queue the detents turned since the last call, call once per loop
+void updateEncoder();
+
+#endif // ENCODER_H
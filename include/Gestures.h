@@ -0,0 +1,34 @@
+#ifndef GESTURES_H
+#define GESTURES_H
+
+#include <Arduino.h>
+#include "KeyboardConfig.h"
+
+//================================
+// GESTURE ENGINE
+//================================
+
+// Sits between debounce and the event queue and turns the activity of
+// gesture-enabled keys into tap, double-tap and long-press events.
+
+#define GESTURE_MODE_ALONGSIDE 0   // Raw press/release events are still sent
+#define GESTURE_MODE_INSTEAD   1   // Gesture keys only send gesture events
+
+#define GESTURE_TIME_UNIT_MS 10    // Thresholds are stored in 10ms steps
+
+extern uint16_t gestureMask[MATRIX_ROWS];       // 1 = key is classified
+extern uint8_t gestureMode;
+extern uint8_t gestureTapMax[MATRIX_KEYS];      // Longest press that is a tap, 0 = no taps
+extern uint8_t gestureDoubleGap[MATRIX_KEYS];   // Longest gap before a second tap, 0 = no double-taps
+extern uint8_t gestureLongPress[MATRIX_KEYS];   // Hold time for a long press, 0 = no long presses
+
+// Reset thresholds to the defaults and disable all keys
+void setupGestures();
+
+// Feed a debounced edge, returns true if the raw event should still be queued
+bool gestureKeyEdge(uint8_t keyIndex, bool keyPressed);
+
+// Fire time-based gestures, call once per scan
+void updateGestures();
+
+#endif // GESTURES_H
@@ -0,0 +1,44 @@
+#ifndef HOLD_TIMING_H
+#define HOLD_TIMING_H
+
+#include <Arduino.h>
+#include "KeyboardConfig.h"
+
+//================================
+// HOLD TIMING
+//================================
+
+// Press times are 16-bit, so keys held longer than HOLD_LIMIT_MS are
+// flagged by a slow periodic check before the tick can wrap.
+//
+// Stuck keys are found by the same check. With masking on, a stuck key is
+// released through the whole pipeline (layers, chords, gestures, repeat)
+// when it is flagged, and its real release later is swallowed.
+
+#define HOLD_LIMIT_MS 60000     // Longer holds are reported as 0xFFFF
+#define STUCK_LIMIT_MAX_S (HOLD_LIMIT_MS / 1000)  // Longer holds cannot be timed with 16-bit ticks
+
+extern bool holdReporting;   // Send releases as KEY_EVENT_RELEASED_HOLD
+extern uint8_t stuckLimit;   // s, 0 = stuck keys are not detected
+extern bool stuckMasking;    // Release stuck keys as soon as they are flagged
+
+// Turn hold reporting and stuck key detection off and clear all flags
+void setupHoldTiming();
+
+// Start every key's hold time now, for keys already held at boot
+void startHoldTimers();
+
+// Start a key's hold time at its press
+void holdKeyPressed(uint8_t keyIndex);
+
+// Clear a key's stuck flags at its release, returns false if the release
+// was already sent when the key was masked
+bool holdKeyReleased(uint8_t keyIndex);
+
+// Flag long holds and stuck keys, call at least every few seconds
+void updateHoldTimers();
+
+// How long a key that is being released was held in ms, 0xFFFF past HOLD_LIMIT_MS
+uint16_t getHoldTime(uint8_t keyIndex);
+
+#endif // HOLD_TIMING_H
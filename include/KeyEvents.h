@@ -0,0 +1,35 @@
+#ifndef KEY_EVENTS_H
+#define KEY_EVENTS_H
+
+#include <Arduino.h>
+
+//================================
+// KEY EVENTS
+//================================
+
+// Event codes, sent as the state byte of a keypress record
+#define KEY_EVENT_RELEASED   0
+#define KEY_EVENT_PRESSED    1
+#define KEY_EVENT_REPEAT     2    // Key is still held, sent by auto-repeat
+#define KEY_EVENT_TAP        3    // Short press and release
+#define KEY_EVENT_DOUBLE_TAP 4    // Second press shortly after a tap
+#define KEY_EVENT_LONG_PRESS 5    // Key held past its long-press time
+#define KEY_EVENT_CHORD      6    // Chord keys pressed together, keyIndex is the chord slot
+#define KEY_EVENT_RELEASED_HOLD 7 // Released, record carries how long the key was held
+#define KEY_EVENT_ENCODER    8    // Encoder turned, keyIndex is the encoder, value the signed detents
+#define KEY_EVENT_STUCK      9    // Key held past the stuck-key limit
+
+// Queue an event for a key (matrix index row * MATRIX_COLS + col), or for
+// KEY_EVENT_CHORD the slot holding the chord's key set. value is the hold
+// time for KEY_EVENT_RELEASED_HOLD and the detent count for KEY_EVENT_ENCODER.
+void addKeyChange(uint8_t keyIndex, uint8_t event, uint16_t value = 0);
+
+// addKeyChange() for an event that belongs to an earlier edge, stamped with
+// that edge's time from keyEventTime()
+void addKeyChangeAt(uint8_t keyIndex, uint8_t event, uint32_t edgeTime, uint16_t value = 0);
+
+// Edge clock (us) an event queued now is stamped with: the edge being
+// processed, otherwise the current time
+uint32_t keyEventTime();
+
+#endif // KEY_EVENTS_H
@@ -0,0 +1,32 @@
+#ifndef KEYBOARD_CONFIG_H
+#define KEYBOARD_CONFIG_H
+
+//================================
+// MATRIX GEOMETRY
+//================================
+
+// The matrix is 4 rows and 10 columns
+// From the backside 0,0 is top right starting at key 401
+#define MATRIX_ROWS 4
+#define MATRIX_COLS 10
+#define MATRIX_KEYS (MATRIX_ROWS * MATRIX_COLS)
+
+//================================
+// KEY INDEX
+//================================
+
+// Key events carry the matrix index (row * MATRIX_COLS + col) in the low
+// 6 bits and the keymap layer that was active when the key went down in
+// the top 2 bits. Keymap commands use the same encoding.
+#define KEY_INDEX_MASK  0x3F
+#define KEY_LAYER_SHIFT 6
+#define KEYMAP_LAYERS   3       // Base layer plus two shift layers, at most 4
+
+#if MATRIX_KEYS > KEY_INDEX_MASK + 1
+#error "Matrix index must fit in 6 bits"
+#endif
+#if KEYMAP_LAYERS > 4
+#error "Layer must fit in 2 bits"
+#endif
+
+#endif // KEYBOARD_CONFIG_H
@@ -0,0 +1,23 @@
+#ifndef KEYMAP_H
+#define KEYMAP_H
+
+#include <Arduino.h>
+#include "KeyboardConfig.h"
+
+//================================
+// KEYMAP
+//================================
+
+// Key number reported for each layer and matrix index (row * MATRIX_COLS + col).
+// Persisted with the other settings by the config store, indexed directly
+// when frames are assembled.
+// Layer 0 is the base layer; 0 in a higher layer means "same as layer 0".
+extern uint16_t keymap[KEYMAP_LAYERS][MATRIX_KEYS];
+
+// Replace the RAM keymap with the factory default (does not touch EEPROM)
+void resetKeymap();
+
+// Key number for a key pressed while a layer was active
+uint16_t keymapLookup(uint8_t layer, uint8_t keyIndex);
+
+#endif // KEYMAP_H
@@ -0,0 +1,40 @@
+#ifndef LAYERS_H
+#define LAYERS_H
+
+#include <Arduino.h>
+#include "KeyboardConfig.h"
+
+//================================
+// LAYER KEYS
+//================================
+
+// Any key can be made a layer modifier. Modifiers send no events of their
+// own; other keys report the key number of the layer that was active when
+// they went down, so press and release always match.
+
+#define LAYER_MODIFIER_SLOTS 4
+
+#define LAYER_MODE_NONE      0
+#define LAYER_MODE_MOMENTARY 1   // Layer is active while the key is held
+#define LAYER_MODE_TOGGLE    2   // Each press switches the layer on or off
+
+struct LayerModifier {
+  uint8_t keyIndex;
+  uint8_t mode;      // LAYER_MODE_*
+  uint8_t layer;     // 1 to KEYMAP_LAYERS - 1
+};
+
+extern LayerModifier layerModifiers[LAYER_MODIFIER_SLOTS];
+
+void setupLayers();
+
+// Configure a modifier slot, returns false if the arguments are out of range
+bool setLayerModifier(uint8_t slot, uint8_t keyIndex, uint8_t mode, uint8_t layer);
+
+// Feed a debounced edge, returns false if the key is a layer modifier
+bool layerKeyEdge(uint8_t keyIndex, bool keyPressed);
+
+// Layer that was active when the key last went down
+uint8_t getKeyLayer(uint8_t keyIndex);
+
+#endif // LAYERS_H
@@ -0,0 +1,30 @@
+#ifndef MATRIX_H
+#define MATRIX_H
+
+#include <Arduino.h>
+#include "KeyboardConfig.h"
+
+//================================
+// MATRIX SCANNER
+//================================
+
+// The scanner in main.cpp owns the pins, the debounced key state and the
+// per-key masks, the stages that work on whole rows read them from here.
+
+extern const uint8_t rowPins[MATRIX_ROWS];
+extern const uint8_t colPins[MATRIX_COLS];
+
+extern uint16_t keyCurrent[MATRIX_ROWS];      // Debounced state, 1 = pressed
+extern uint16_t keyEventMask[MATRIX_ROWS];    // 0 = key changes are not queued
+
+// Read all columns at once, bit n = column n, 1 = pulled low
+uint16_t readColumns();
+
+// A debounced edge (or a release made up by the firmware) through layers,
+// chords and gestures into the queue
+void processKeyEdge(uint8_t keyIndex, bool keyPressed);
+
+// Translate a layer-tagged matrix index to the 101-410 key numbering
+uint16_t keyNumberForIndex(uint8_t keyIndex);
+
+#endif // MATRIX_H
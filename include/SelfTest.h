@@ -0,0 +1,30 @@
+#ifndef SELF_TEST_H
+#define SELF_TEST_H
+
+#include <Arduino.h>
+#include "KeyboardConfig.h"
+
+//================================
+// MATRIX SELF-TEST
+//================================
+
+// Rows and columns are all pulled up and driven low one line at a time.
+// A line that reads low with nothing driven is shorted to ground, a line
+// that follows the driven one is shorted to it unless closed keys connect
+// the two. Both lines of a short are left out of scanning, so a damaged
+// harness cannot flood the queue with phantom keys. Keys held during the
+// test are reported but stay in use, they may just be held.
+
+#define SELF_TEST_SETTLE_US 10   // Line settling time after changing what is driven
+
+extern uint8_t rowFaults;                 // Bit n = row n is shorted
+extern uint16_t columnFaults;             // Bit n = column n is shorted
+extern uint16_t closedAtTest[MATRIX_ROWS];   // Keys that read closed during the test
+
+// Test every line, takes well under 1ms. Leaves the good rows driven high.
+void runSelfTest();
+
+// Columns of a row that are on good lines, 0 if the row itself is faulty
+uint16_t selfTestGoodKeys(uint8_t row);
+
+#endif // SELF_TEST_H
@@ -0,0 +1,23 @@
+#ifndef STACK_MONITOR_H
+#define STACK_MONITOR_H
+
+#include <Arduino.h>
+
+//================================
+// STACK MONITOR
+//================================
+
+// All RAM between the end of .bss and the top of the stack is painted with a
+// canary byte before main() runs. The lowest byte the stack ever overwrote
+// marks the worst-case depth reached so far.
+
+// Rescan the painted region, call from the loop (not from an ISR)
+void updateStackWatermark();
+
+// Bytes between .bss and the deepest stack use seen so far, 0 = collision
+uint16_t getStackFreeLowWater();
+
+// Total bytes available to the stack (size of the painted region)
+uint16_t getStackRegionSize();
+
+#endif // STACK_MONITOR_H
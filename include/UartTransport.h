@@ -0,0 +1,37 @@
+#ifndef UART_TRANSPORT_H
+#define UART_TRANSPORT_H
+
+#include <Arduino.h>
+
+//================================
+// UART TRANSPORT
+//================================
+
+// Carries the same frames as I2C over the RX/TX header. Frames are pushed
+// as soon as they are ready instead of being polled. On the wire every
+// frame is followed by a CRC-16/CCITT-FALSE (poly 0x1021, init 0xFFFF,
+// high byte first), COBS encoded and terminated by a 0x00 byte. Commands
+// from the controller use the same framing.
+//
+// Uses HardwareSerial, which already transmits from an interrupt-driven
+// ring buffer, so debug output is not available in this mode.
+
+#ifndef UART_BAUD
+#define UART_BAUD 500000     // 250000, 500000 and 1000000 are exact at 8MHz
+#endif
+
+#define UART_MAX_PAYLOAD 32  // Largest frame or command carried
+
+void setupUartTransport();
+
+// True if a frame of this length can be queued without blocking
+bool uartCanSend(uint8_t length);
+
+// Queue one frame for sending
+void uartSendFrame(const uint8_t* frame, uint8_t length);
+
+// Collect received bytes, returns true once a complete command with a valid
+// CRC is in command (at least UART_MAX_PAYLOAD bytes)
+bool uartReceiveCommand(uint8_t* command, uint8_t* length);
+
+#endif // UART_TRANSPORT_H
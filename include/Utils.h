@@ -10,8 +10,12 @@
 // Debug setting
 extern bool debugMode;
 
-// Debug print functions - only output if debug mode is enabled
-void debugPrint(const char* message);
-void debugPrintf(const char* format, ...);
+// Debug print functions - only output if debug mode is enabled.
+// Messages and formats live in flash, call them with string literals only.
+void debugPrint_P(PGM_P message);
+void debugPrintf_P(PGM_P format, ...);
+
+#define debugPrint(message) debugPrint_P(PSTR(message))
+#define debugPrintf(format, ...) debugPrintf_P(PSTR(format), ##__VA_ARGS__)
 
 #endif // UTILS_H
\ No newline at end of file
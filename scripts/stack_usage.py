@@ -0,0 +1,155 @@
+# Worst-case stack estimate, run by PlatformIO after the firmware is linked.
+#
+# Frame sizes come from the .su files written by -fstack-usage (build_flags), the call graph
+# from disassembling the linked .elf. The result is the deepest call chain from
+# main() plus the deepest interrupt handler on top of it (interrupts do not
+# nest on this firmware). Functions without a .su entry (precompiled avr-libc
+# such as vfprintf) use the sizes in ASSUMED_FRAMES, or count as 0 and are
+# listed so the estimate can be judged.
+
+import os
+import re
+import subprocess
+
+Import("env")
+
+RETURN_ADDRESS_BYTES = 2  # ATmega328P has a 16-bit program counter
+
+# Rough frame sizes for library code built without -fstack-usage
+ASSUMED_FRAMES = {
+    "vfprintf": 60,
+    "vsnprintf": 20,
+    "vsnprintf_P": 20,
+    "__ultoa_invert": 0,
+}
+
+# Callbacks reached through function pointers, caller -> callees
+INDIRECT_CALLS = {
+    "__vector_24": ["onRequestService", "onReceiveService"],  # TWI ISR -> twi_onSlaveTransmit/Receive
+    "onRequestService": ["sendKeyboardData"],                 # Wire.onRequest()
+    "onReceiveService": ["receiveCommand"],                   # Wire.onReceive()
+}
+
+SU_LINE = re.compile(r"^.*:\d+:\d+:(?P<decl>.*)\t(?P<size>\d+)\t(?P<kind>\S+)$")
+FUNC_HEADER = re.compile(r"^[0-9a-f]+ <(?P<name>[^>]+)>:$")
+CALL_INSN = re.compile(r"\s(?P<insn>r?call|r?jmp)\s+(?:0x)?[0-9a-f]+\s+<(?P<target>[^>+]+)(?:\+0x[0-9a-f]+)?>")
+ICALL_INSN = re.compile(r"\s(?:e?icall|e?ijmp)\b")
+
+
+def bare_name(decl):
+    # "uint16_t keyNumberForIndex(uint8_t)" / "TwoWire::write(unsigned char)" -> last identifier before "("
+    head = decl.split("(", 1)[0]
+    return re.split(r"[\s:*&]+", head.strip())[-1]
+
+
+def read_frames(build_dir):
+    frames = {}
+    dynamic = set()
+    for root, _, files in os.walk(build_dir):
+        for name in files:
+            if not name.endswith(".su"):
+                continue
+            with open(os.path.join(root, name)) as su:
+                for line in su:
+                    match = SU_LINE.match(line.rstrip("\n"))
+                    if not match:
+                        continue
+                    func = bare_name(match.group("decl"))
+                    frames[func] = max(frames.get(func, 0), int(match.group("size")))
+                    if match.group("kind") != "static":
+                        dynamic.add(func)
+    return frames, dynamic
+
+
+def read_call_graph(objdump, elf, tool_env):
+    # The toolchain is only on the build environment's PATH, not the host's
+    output = subprocess.check_output([objdump, "-d", "-C", elf], env=tool_env, universal_newlines=True)
+    graph = {}
+    indirect = set()
+    current = None
+    for line in output.splitlines():
+        header = FUNC_HEADER.match(line)
+        if header:
+            current = bare_name(header.group("name"))
+            graph.setdefault(current, set())
+            continue
+        if current is None:
+            continue
+        call = CALL_INSN.search(line)
+        if call:
+            target = bare_name(call.group("target"))
+            # Jumps to self are loops, calls to self are recursion
+            if target != current or call.group("insn").endswith("call"):
+                graph[current].add(target)
+        elif ICALL_INSN.search(line):
+            indirect.add(current)
+    for caller, callees in INDIRECT_CALLS.items():
+        if caller in graph:
+            graph[caller].update(callees)
+            indirect.discard(caller)
+    return graph, indirect
+
+
+def worst_case(func, graph, frames, memo, stack, unknown, recursive):
+    if func in memo:
+        return memo[func]
+    if func in stack:
+        recursive.add(func)
+        return 0
+    if func not in frames:
+        if func in ASSUMED_FRAMES:
+            own = ASSUMED_FRAMES[func]
+        else:
+            own = 0
+            if func in graph:
+                unknown.add(func)
+    else:
+        own = frames[func]
+    stack.add(func)
+    deepest = 0
+    for callee in graph.get(func, ()):
+        depth = worst_case(callee, graph, frames, memo, stack, unknown, recursive)
+        deepest = max(deepest, depth + RETURN_ADDRESS_BYTES)
+    stack.discard(func)
+    memo[func] = own + deepest
+    return memo[func]
+
+
+def report_stack_usage(source, target, env):
+    # Only a report, nothing here may fail the build
+    try:
+        print_stack_usage(str(target[0]), env)
+    except Exception as error:
+        print("Stack estimate skipped: %s" % error)
+
+
+def print_stack_usage(elf, env):
+    build_dir = env.subst("$BUILD_DIR")
+    objdump = env.subst("$OBJDUMP") if env.get("OBJDUMP") else "avr-objdump"
+
+    frames, dynamic = read_frames(build_dir)
+    graph, indirect = read_call_graph(objdump, elf, env["ENV"])
+
+    memo, unknown, recursive = {}, set(), set()
+    main_depth = worst_case("main", graph, frames, memo, set(), unknown, recursive)
+
+    isr_depth, isr_name = 0, None
+    for func in graph:
+        if func.startswith("__vector_"):
+            depth = worst_case(func, graph, frames, memo, set(), unknown, recursive) + RETURN_ADDRESS_BYTES
+            if depth > isr_depth:
+                isr_depth, isr_name = depth, func
+
+    print("Stack estimate: main() %d bytes + deepest ISR %s %d bytes = %d bytes"
+          % (main_depth, isr_name, isr_depth, main_depth + isr_depth))
+    if indirect:
+        print("  Indirect calls not followed in: %s" % ", ".join(sorted(indirect)))
+    if recursive:
+        print("  Recursion (counted once): %s" % ", ".join(sorted(recursive)))
+    if dynamic:
+        print("  Dynamic frames (size is a minimum): %s" % ", ".join(sorted(dynamic)))
+    if unknown:
+        print("  No frame size for: %s" % ", ".join(sorted(unknown)))
+
+
+env.AddPostAction("$BUILD_DIR/${PROGNAME}.elf", report_stack_usage)
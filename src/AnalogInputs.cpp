@@ -0,0 +1,118 @@
+#include "AnalogInputs.h"
+
+// Only built when enabled, an ADC vector is linked in even if never used
+#ifdef ANALOG_INPUT
+#include <avr/interrupt.h>
+#include "Utils.h"
+
+//================================
+// ADC SAMPLING
+//================================
+
+// Free running at 8MHz / 128 = 62.5kHz ADC clock, a conversion every 208us
+#define ADC_PRESCALER (_BV(ADPS2) | _BV(ADPS1) | _BV(ADPS0))
+#define FILTER_FRACTION_BITS 3  // Filtered values keep 3 extra bits, 12 + 3 fits an int16_t
+
+static const uint8_t analogMux[ANALOG_CHANNELS] = {6, 7};   // ADC6 = A6, ADC7 = A7
+
+// === Shared With The ISR ===
+static volatile uint16_t sampleSum[ANALOG_CHANNELS];   // Latest completed oversampled sum
+static volatile uint8_t freshSums = 0;                 // Bit n = sampleSum[n] not filtered yet
+
+// === ISR Only ===
+static uint8_t sampleChannel = 0;
+static uint8_t sampleCount = 0;
+static uint16_t runningSum = 0;
+static bool discardNext = true;
+
+// === Loop Side ===
+static int16_t filtered[ANALOG_CHANNELS];
+static uint16_t reported[ANALOG_CHANNELS];
+static uint8_t seenChannels = 0;        // Bit n = channel n has a first value
+static volatile bool changePending = false;
+
+// In free-running mode the next conversion has already started when this
+// runs, so a new channel only applies from the one after. That conversion
+// still belongs to the old channel and is thrown away.
+ISR(ADC_vect) {
+  uint16_t sample = ADC;
+  
+  if (discardNext) {
+    discardNext = false;
+    return;
+  }
+  
+  runningSum += sample;
+  if (++sampleCount < ANALOG_OVERSAMPLE) {
+    return;
+  }
+  
+  sampleSum[sampleChannel] = runningSum;
+  freshSums |= (uint8_t)(1 << sampleChannel);
+  runningSum = 0;
+  sampleCount = 0;
+  
+  sampleChannel = (sampleChannel + 1) % ANALOG_CHANNELS;
+  ADMUX = _BV(REFS0) | analogMux[sampleChannel];
+  discardNext = true;
+}
+
+void setupAnalogInputs() {
+  // A6/A7 have no digital input buffer, so there is nothing to disable
+  ADMUX = _BV(REFS0) | analogMux[0];    // AVcc reference
+  ADCSRB = 0;                           // Free running trigger
+  ADCSRA = _BV(ADEN) | _BV(ADATE) | _BV(ADIE) | ADC_PRESCALER;
+  ADCSRA |= _BV(ADSC);
+}
+
+void updateAnalogInputs() {
+  for (uint8_t channel = 0; channel < ANALOG_CHANNELS; channel++) {
+    uint8_t bit = (uint8_t)(1 << channel);
+    
+    noInterrupts();
+    bool fresh = (freshSums & bit) != 0;
+    uint16_t sum = sampleSum[channel];
+    freshSums &= ~bit;
+    interrupts();
+    
+    if (!fresh) {
+      continue;
+    }
+    
+    // 16 x 10 bits -> 12 bits, then into the filter's fixed point
+    int16_t target = (int16_t)((sum >> 2) << FILTER_FRACTION_BITS);
+    if (!(seenChannels & bit)) {
+      filtered[channel] = target;
+    } else {
+      filtered[channel] += (target - filtered[channel]) >> ANALOG_FILTER_SHIFT;
+    }
+    
+    uint16_t value = (uint16_t)filtered[channel] >> FILTER_FRACTION_BITS;
+    uint16_t distance = (value > reported[channel]) ? value - reported[channel] : reported[channel] - value;
+    
+    if (!(seenChannels & bit) || distance >= ANALOG_HYSTERESIS) {
+      seenChannels |= bit;
+      
+      noInterrupts();
+      reported[channel] = value;
+      changePending = true;
+      interrupts();
+      
+      debugPrintf("[ANALOG] A%d = %u", analogMux[channel], value);
+    }
+  }
+}
+
+bool analogChangePending() {
+  return changePending;
+}
+
+uint16_t getAnalogValue(uint8_t channel) {
+  return reported[channel];
+}
+
+void clearAnalogChange() {
+  changePending = false;
+}
+
+#endif // ANALOG_INPUT
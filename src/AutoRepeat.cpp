@@ -0,0 +1,76 @@
+#include "AutoRepeat.h"
+#include "KeyEvents.h"
+#include "Matrix.h"
+
+//================================
+// AUTO-REPEAT STATE
+//================================
+
+#define NO_REPEAT_KEY 0xFF
+
+uint16_t repeatMask[MATRIX_ROWS];
+uint16_t repeatDelay = REPEAT_DELAY_MS;
+uint16_t repeatInterval = REPEAT_INTERVAL_MS;
+
+static uint8_t repeatKey = NO_REPEAT_KEY;   // Key index currently repeating
+static uint16_t repeatDueTick = 0;          // When the next repeat is sent
+
+void setupAutoRepeat() {
+  for (uint8_t row = 0; row < MATRIX_ROWS; row++) {
+    repeatMask[row] = 0;
+  }
+  repeatDelay = REPEAT_DELAY_MS;
+  repeatInterval = REPEAT_INTERVAL_MS;
+  repeatKey = NO_REPEAT_KEY;
+}
+
+// A press takes over repeating and releasing the repeating key stops it
+void trackRepeatKey(uint8_t keyIndex, bool keyPressed) {
+  if (keyPressed) {
+    uint8_t row = keyIndex / MATRIX_COLS;
+    uint8_t col = keyIndex % MATRIX_COLS;
+    
+    if (repeatMask[row] & ((uint16_t)1 << col)) {
+      repeatKey = keyIndex;
+      repeatDueTick = (uint16_t)millis() + repeatDelay;
+    }
+  } else if (keyIndex == repeatKey) {
+    repeatKey = NO_REPEAT_KEY;
+  }
+}
+
+// Longer times would read as already due in updateAutoRepeat()
+void setRepeatTiming(uint16_t delayMs, uint16_t intervalMs) {
+  repeatDelay = (delayMs > REPEAT_TIME_MAX_MS) ? REPEAT_TIME_MAX_MS : delayMs;
+  repeatInterval = (intervalMs > REPEAT_TIME_MAX_MS) ? REPEAT_TIME_MAX_MS : intervalMs;
+  if (repeatInterval == 0) {
+    repeatInterval = 1;
+  }
+}
+
+void updateAutoRepeat() {
+  if (repeatKey == NO_REPEAT_KEY) {
+    return;
+  }
+  
+  // The master may have disabled repeat or the whole key while it was held
+  uint8_t row = repeatKey / MATRIX_COLS;
+  uint16_t mask = (uint16_t)1 << (repeatKey % MATRIX_COLS);
+  if (!(repeatMask[row] & keyCurrent[row] & mask)) {
+    repeatKey = NO_REPEAT_KEY;
+    return;
+  }
+  
+  uint16_t currentTick = (uint16_t)millis();
+  
+  // Wrap-safe "due tick has passed"
+  if ((int16_t)(currentTick - repeatDueTick) >= 0) {
+    addKeyChange(repeatKey, KEY_EVENT_REPEAT);
+    repeatDueTick += repeatInterval;
+    
+    // Never try to catch up with a burst after the loop was held up
+    if ((int16_t)(currentTick - repeatDueTick) >= 0) {
+      repeatDueTick = currentTick + repeatInterval;
+    }
+  }
+}
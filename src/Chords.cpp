@@ -0,0 +1,100 @@
+#include "Chords.h"
+#include "KeyEvents.h"
+
+//================================
+// CHORD STATE
+//================================
+
+#define DEFAULT_CHORD_WINDOW 50
+
+uint16_t chordMask[MATRIX_ROWS];
+uint8_t chordWindow = DEFAULT_CHORD_WINDOW;
+
+static uint16_t pendingKeys[MATRIX_ROWS];    // Pressed while the window is open
+static uint16_t consumedKeys[MATRIX_ROWS];   // Sent as part of a chord, releases are swallowed
+static uint8_t pendingCount = 0;
+static uint8_t pendingFirstKey = 0;
+static uint16_t windowStartTick = 0;
+static uint32_t windowStartTime = 0;         // Edge time of the first press in the window
+
+static uint8_t chordKeys[CHORD_SLOTS][CHORD_MASK_BYTES];
+static uint8_t nextChordSlot = 0;
+
+void setupChords() {
+  for (uint8_t row = 0; row < MATRIX_ROWS; row++) {
+    chordMask[row] = 0;
+    pendingKeys[row] = 0;
+    consumedKeys[row] = 0;
+  }
+  pendingCount = 0;
+}
+
+// Send what the window collected: a chord for two or more keys, otherwise
+// the delayed press of the single key
+static void closeChordWindow() {
+  if (pendingCount >= 2) {
+    uint8_t slot = nextChordSlot;
+    nextChordSlot = (nextChordSlot + 1) % CHORD_SLOTS;
+    
+    memset(chordKeys[slot], 0, CHORD_MASK_BYTES);
+    for (uint8_t row = 0; row < MATRIX_ROWS; row++) {
+      for (uint8_t col = 0; col < MATRIX_COLS; col++) {
+        if (pendingKeys[row] & ((uint16_t)1 << col)) {
+          uint8_t keyIndex = row * MATRIX_COLS + col;
+          chordKeys[slot][keyIndex >> 3] |= 1 << (keyIndex & 7);
+        }
+      }
+      consumedKeys[row] |= pendingKeys[row];
+    }
+    
+    addKeyChangeAt(slot, KEY_EVENT_CHORD, windowStartTime);
+  } else if (pendingCount == 1) {
+    addKeyChangeAt(pendingFirstKey, KEY_EVENT_PRESSED, windowStartTime);
+  }
+  
+  for (uint8_t row = 0; row < MATRIX_ROWS; row++) {
+    pendingKeys[row] = 0;
+  }
+  pendingCount = 0;
+}
+
+bool chordKeyEdge(uint8_t keyIndex, bool keyPressed) {
+  uint8_t row = keyIndex / MATRIX_COLS;
+  uint16_t mask = (uint16_t)1 << (keyIndex % MATRIX_COLS);
+  
+  if (keyPressed) {
+    if (chordWindow == 0 || !(chordMask[row] & mask)) {
+      return true;
+    }
+    
+    if (pendingCount == 0) {
+      windowStartTick = (uint16_t)millis();
+      windowStartTime = keyEventTime();
+      pendingFirstKey = keyIndex;
+    }
+    pendingKeys[row] |= mask;
+    pendingCount++;
+    return false;
+  }
+  
+  // A release ends the window early so its press is sent before it
+  if (pendingKeys[row] & mask) {
+    closeChordWindow();
+  }
+  
+  if (consumedKeys[row] & mask) {
+    consumedKeys[row] &= ~mask;
+    return false;
+  }
+  return true;
+}
+
+void updateChords() {
+  if (pendingCount != 0 && (uint16_t)((uint16_t)millis() - windowStartTick) >= chordWindow) {
+    closeChordWindow();
+  }
+}
+
+void getChordKeys(uint8_t slot, uint8_t* keys) {
+  memcpy(keys, chordKeys[slot % CHORD_SLOTS], CHORD_MASK_BYTES);
+}
@@ -0,0 +1,204 @@
+#include "ConfigStore.h"
+#include <avr/eeprom.h>
+#include <util/crc16.h>
+#include "Utils.h"
+
+//================================
+// RECORD LAYOUT
+//================================
+
+// magic, sequence (2), payload size (2), payload, CRC (2)
+// The CRC covers sequence, size and payload
+#define CONFIG_MAGIC 0xC5
+#define CONFIG_HEADER_SIZE 5
+#define CONFIG_CRC_SIZE 2
+#define CONFIG_MAX_SLOTS 32   // Slots rejected at load are tracked in a 32-bit mask
+
+// === Save Steps ===
+#define SAVE_IDLE       0
+#define SAVE_INVALIDATE 1   // Clear the target slot's magic
+#define SAVE_BODY       2   // Sequence, size, payload, CRC, one byte per step
+#define SAVE_COMMIT     3   // Write the magic, the record is now valid
+
+static uint8_t* regionData(const ConfigStore* store, uint8_t index) {
+  return (uint8_t*)pgm_read_ptr(&store->regions[index].data);
+}
+
+static uint16_t regionSize(const ConfigStore* store, uint8_t index) {
+  return pgm_read_word(&store->regions[index].size);
+}
+
+static uint8_t* slotAddress(const ConfigStore* store, uint8_t slot) {
+  return (uint8_t*)(store->base + slot * store->slotSize);
+}
+
+void setupConfigStore(ConfigStore* store, const ConfigRegion* regions, uint8_t count,
+                      uint16_t base, uint16_t size) {
+  store->regions = regions;
+  store->regionCount = count;
+  store->base = base;
+  
+  store->payloadSize = 0;
+  for (uint8_t i = 0; i < count; i++) {
+    store->payloadSize += regionSize(store, i);
+  }
+  
+  store->slotSize = CONFIG_HEADER_SIZE + store->payloadSize + CONFIG_CRC_SIZE;
+  uint16_t slots = size / store->slotSize;
+  store->slotCount = (slots > CONFIG_MAX_SLOTS) ? CONFIG_MAX_SLOTS : (uint8_t)slots;
+  
+  store->newestSlot = 0xFF;
+  store->newestSequence = 0;
+  store->saveStep = SAVE_IDLE;
+  store->saveRequested = false;
+  
+  if (store->slotCount < 2) {
+    debugPrintf("[CONFIG] Area at 0x%03X holds %d slots, saves are not power-fail safe",
+                base, store->slotCount);
+  }
+}
+
+// Payload byte at an offset, walking the regions in order
+static uint8_t payloadByte(const ConfigStore* store, uint16_t offset) {
+  for (uint8_t i = 0; i < store->regionCount; i++) {
+    uint16_t size = regionSize(store, i);
+    if (offset < size) {
+      return regionData(store, i)[offset];
+    }
+    offset -= size;
+  }
+  return 0;
+}
+
+// Sequence number of a slot whose magic and size look right, the CRC is
+// only checked for the slot that is actually picked
+static bool slotHeader(const ConfigStore* store, uint8_t slot, uint16_t* sequence) {
+  const uint8_t* address = slotAddress(store, slot);
+  
+  if (eeprom_read_byte(address) != CONFIG_MAGIC ||
+      eeprom_read_word((const uint16_t*)(address + 3)) != store->payloadSize) {
+    return false;
+  }
+  *sequence = eeprom_read_word((const uint16_t*)(address + 1));
+  return true;
+}
+
+static bool slotCrcValid(const ConfigStore* store, uint8_t slot) {
+  const uint8_t* address = slotAddress(store, slot) + 1;
+  uint16_t length = CONFIG_HEADER_SIZE - 1 + store->payloadSize;
+  uint16_t crc = 0xFFFF;
+  
+  for (uint16_t i = 0; i < length; i++) {
+    crc = _crc_xmodem_update(crc, eeprom_read_byte(address + i));
+  }
+  return eeprom_read_word((const uint16_t*)(address + length)) == crc;
+}
+
+bool loadConfig(ConfigStore* store) {
+  uint32_t rejected = 0;   // Slots whose CRC failed
+  
+  // Newest record first, older ones only if it turns out to be damaged
+  for (;;) {
+    store->newestSlot = 0xFF;
+    for (uint8_t slot = 0; slot < store->slotCount; slot++) {
+      uint16_t sequence;
+      if (!(rejected & ((uint32_t)1 << slot)) && slotHeader(store, slot, &sequence) &&
+          (store->newestSlot == 0xFF || (int16_t)(sequence - store->newestSequence) > 0)) {
+        store->newestSlot = slot;
+        store->newestSequence = sequence;
+      }
+    }
+    
+    if (store->newestSlot == 0xFF || slotCrcValid(store, store->newestSlot)) {
+      break;
+    }
+    debugPrintf("[CONFIG] Slot %d at 0x%03X CRC mismatch", store->newestSlot, store->base);
+    rejected |= (uint32_t)1 << store->newestSlot;
+  }
+  
+  if (store->newestSlot == 0xFF) {
+    debugPrintf("[CONFIG] No valid record at 0x%03X - using defaults", store->base);
+    return false;
+  }
+  
+  const uint8_t* address = slotAddress(store, store->newestSlot) + CONFIG_HEADER_SIZE;
+  for (uint8_t i = 0; i < store->regionCount; i++) {
+    uint16_t size = regionSize(store, i);
+    eeprom_read_block(regionData(store, i), address, size);
+    address += size;
+  }
+  
+  debugPrintf("[CONFIG] Loaded record %u from slot %d at 0x%03X",
+              store->newestSequence, store->newestSlot, store->base);
+  return true;
+}
+
+void saveConfig(ConfigStore* store) {
+  store->saveRequested = true;
+}
+
+// Byte of the record body (everything after the magic) at an offset.
+// The CRC is built up from the bytes as they are written, so the record
+// always matches what is actually in EEPROM even if RAM changes meanwhile.
+static uint8_t bodyByte(ConfigStore* store, uint16_t offset) {
+  uint16_t crcOffset = CONFIG_HEADER_SIZE - 1 + store->payloadSize;
+  
+  if (offset < crcOffset) {
+    uint8_t value;
+    if (offset < 2) {
+      value = (uint8_t)(store->saveSequence >> (offset * 8));
+    } else if (offset < 4) {
+      value = (uint8_t)(store->payloadSize >> ((offset - 2) * 8));
+    } else {
+      value = payloadByte(store, offset - 4);
+    }
+    store->saveCrc = _crc_xmodem_update(store->saveCrc, value);
+    return value;
+  }
+  
+  return (uint8_t)(store->saveCrc >> ((offset - crcOffset) * 8));
+}
+
+void updateConfigStore(ConfigStore* store) {
+  if (store->slotCount == 0 || !eeprom_is_ready()) {
+    return;
+  }
+  
+  uint8_t* address = slotAddress(store, store->saveSlot);
+  
+  switch (store->saveStep) {
+    case SAVE_IDLE:
+      if (!store->saveRequested) {
+        return;
+      }
+      store->saveRequested = false;
+      store->saveSlot = (store->newestSlot == 0xFF) ? 0 : (uint8_t)((store->newestSlot + 1) % store->slotCount);
+      store->saveSequence = store->newestSequence + 1;
+      store->savePosition = 0;
+      store->saveCrc = 0xFFFF;
+      store->saveStep = SAVE_INVALIDATE;
+      break;
+    
+    case SAVE_INVALIDATE:
+      eeprom_update_byte(address, 0xFF);
+      store->saveStep = SAVE_BODY;
+      break;
+    
+    case SAVE_BODY:
+      eeprom_update_byte(address + 1 + store->savePosition, bodyByte(store, store->savePosition));
+      store->savePosition++;
+      if (store->savePosition == store->slotSize - 1) {
+        store->saveStep = SAVE_COMMIT;
+      }
+      break;
+    
+    case SAVE_COMMIT:
+      eeprom_update_byte(address, CONFIG_MAGIC);
+      store->newestSlot = store->saveSlot;
+      store->newestSequence = store->saveSequence;
+      store->saveStep = SAVE_IDLE;
+      debugPrintf("[CONFIG] Saved record %u to slot %d at 0x%03X",
+                  store->saveSequence, store->saveSlot, store->base);
+      break;
+  }
+}
@@ -0,0 +1,79 @@
+#include "Debounce.h"
+#include "Utils.h"
+
+//================================
+// DEBOUNCE STATE
+//================================
+
+uint8_t debounceWindow[MATRIX_KEYS];
+uint8_t debounceMin = DEBOUNCE_MIN_MS;
+uint8_t debounceMax = DEBOUNCE_MIN_MS;
+
+static uint8_t lastBounce[MATRIX_KEYS];   // Latest bounce in the current lockout, 0 = none
+static uint8_t cleanEdges[MATRIX_KEYS];   // Edges in a row that would fit a shorter window
+static bool tuningChanged = false;
+
+void setupDebounce(uint8_t maxWindow) {
+  debounceMax = maxWindow;
+  for (uint8_t i = 0; i < MATRIX_KEYS; i++) {
+    debounceWindow[i] = maxWindow;
+    lastBounce[i] = 0;
+    cleanEdges[i] = 0;
+  }
+}
+
+void setDebounceBounds(uint8_t minWindow, uint8_t maxWindow) {
+  debounceMin = minWindow;
+  debounceMax = maxWindow;
+  
+  for (uint8_t i = 0; i < MATRIX_KEYS; i++) {
+    uint8_t window = debounceWindow[i];
+    window = (window < minWindow) ? minWindow : (window > maxWindow) ? maxWindow : window;
+    if (window != debounceWindow[i]) {
+      debounceWindow[i] = window;
+      tuningChanged = true;
+    }
+  }
+}
+
+void debounceEdge(uint8_t keyIndex) {
+  lastBounce[keyIndex] = 0;
+}
+
+void debounceBounce(uint8_t keyIndex, uint8_t sinceEdge) {
+  lastBounce[keyIndex] = (sinceEdge != 0) ? sinceEdge : 1;
+}
+
+void debounceSettled(uint8_t keyIndex) {
+  uint8_t window = debounceWindow[keyIndex];
+  uint8_t bounce = lastBounce[keyIndex];
+  uint16_t needed = (bounce != 0) ? (uint16_t)bounce * 2 + DEBOUNCE_TUNE_MARGIN_MS : 0;
+  
+  if (needed > window) {
+    // Too short, the key may already have bounced past it
+    window = (needed > debounceMax) ? debounceMax : (uint8_t)needed;
+    cleanEdges[keyIndex] = 0;
+  } else if (needed < window && window > debounceMin) {
+    if (++cleanEdges[keyIndex] < DEBOUNCE_DECAY_EDGES) {
+      return;
+    }
+    cleanEdges[keyIndex] = 0;
+    window--;
+  } else {
+    cleanEdges[keyIndex] = 0;
+    return;
+  }
+  
+  if (window != debounceWindow[keyIndex]) {
+    debugPrintf("[DEBOUNCE] Key %d window %d -> %d ms (bounce %d ms)",
+               keyIndex, debounceWindow[keyIndex], window, bounce);
+    debounceWindow[keyIndex] = window;
+    tuningChanged = true;
+  }
+}
+
+bool takeDebounceTuningChanged() {
+  bool changed = tuningChanged;
+  tuningChanged = false;
+  return changed;
+}
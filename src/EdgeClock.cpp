@@ -0,0 +1,35 @@
+#include "EdgeClock.h"
+#include <avr/interrupt.h>
+
+//================================
+// TIMER1 CLOCK
+//================================
+
+static volatile uint16_t clockHigh = 0;   // Timer1 overflows, upper half of the clock
+
+ISR(TIMER1_OVF_vect) {
+  clockHigh++;
+}
+
+void setupEdgeClock() {
+  TCCR1A = 0;                // Normal mode, no PWM outputs
+  TCCR1B = _BV(CS11);        // clk/8
+  TCNT1 = 0;
+  TIFR1 = _BV(TOV1);
+  TIMSK1 = _BV(TOIE1);
+}
+
+uint32_t edgeClockMicros() {
+  uint8_t sreg = SREG;
+  noInterrupts();
+  uint16_t high = clockHigh;
+  uint16_t low = TCNT1;
+  
+  // Wrapped but the overflow interrupt has not run yet
+  if ((TIFR1 & _BV(TOV1)) && low < 0x8000) {
+    high++;
+  }
+  SREG = sreg;
+  
+  return ((uint32_t)high << 16) | low;
+}
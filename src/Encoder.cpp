@@ -0,0 +1,65 @@
+#include "Encoder.h"
+
+// Only built when enabled, the PCINT0 vector would be linked in regardless
+#ifdef ENCODER_INPUT
+#include <avr/interrupt.h>
+#include "KeyEvents.h"
+#include "Utils.h"
+
+//================================
+// QUADRATURE DECODING
+//================================
+
+// D10 = PB2 (PCINT2), D13 = PB5 (PCINT5), both in pin-change group 0
+#define ENCODER_PIN_A 10
+#define ENCODER_PIN_B 13
+#define ENCODER_BIT_A 2
+#define ENCODER_BIT_B 5
+
+// Step for (previous AB << 2) | current AB, +1 = clockwise
+static const int8_t quadratureSteps[16] = {
+   0, -1,  1,  0,
+   1,  0,  0, -1,
+  -1,  0,  0,  1,
+   0,  1, -1,  0
+};
+
+static volatile int16_t encoderSteps = 0;   // Steps not yet taken as detents
+static uint8_t encoderState = 0;            // Last AB levels, only used by the ISR
+
+static uint8_t readEncoderPins() {
+  uint8_t levels = PINB;
+  return (uint8_t)((((levels >> ENCODER_BIT_A) & 1) << 1) | ((levels >> ENCODER_BIT_B) & 1));
+}
+
+// Only D10 and D13 are enabled in PCMSK0, the column pins on port B never fire it
+ISR(PCINT0_vect) {
+  uint8_t state = readEncoderPins();
+  encoderSteps += quadratureSteps[(encoderState << 2) | state];
+  encoderState = state;
+}
+
+void setupEncoder() {
+  pinMode(ENCODER_PIN_A, INPUT_PULLUP);
+  pinMode(ENCODER_PIN_B, INPUT_PULLUP);
+  encoderState = readEncoderPins();
+  
+  PCMSK0 |= _BV(PCINT2) | _BV(PCINT5);
+  PCIFR = _BV(PCIF0);     // Drop any edge seen while the pull-ups came on
+  PCICR |= _BV(PCIE0);
+}
+
+void updateEncoder() {
+  noInterrupts();
+  int16_t steps = encoderSteps;
+  int16_t detents = steps / ENCODER_STEPS_PER_DETENT;
+  encoderSteps = steps - detents * ENCODER_STEPS_PER_DETENT;   // Keep the part of a detent
+  interrupts();
+  
+  if (detents != 0) {
+    addKeyChange(0, KEY_EVENT_ENCODER, (uint16_t)detents);
+    debugPrintf("[ENCODER] %d detents", detents);
+  }
+}
+
+#endif // ENCODER_INPUT
@@ -0,0 +1,140 @@
+#include "Gestures.h"
+#include "KeyEvents.h"
+
+//================================
+// GESTURE SETTINGS
+//================================
+
+#define GESTURE_SLOTS 4              // Keys that can be mid-gesture at once
+#define DEFAULT_TAP_MAX 25           // 250ms
+#define DEFAULT_DOUBLE_GAP 25        // 250ms
+#define DEFAULT_LONG_PRESS 80        // 800ms
+
+// === Slot States ===
+#define GESTURE_FREE        0
+#define GESTURE_FIRST_DOWN  1   // Pressed, could become a tap or long press
+#define GESTURE_WAIT_SECOND 2   // Tapped, waiting to see if a second press follows
+#define GESTURE_SECOND_DOWN 3   // Double-tap sent, waiting for release
+#define GESTURE_LONG_HELD   4   // Long press sent, waiting for release
+
+struct GestureSlot {
+  uint8_t keyIndex;
+  uint8_t state;
+  uint16_t tick;     // Low 16 bits of millis() when the current state started
+};
+
+uint16_t gestureMask[MATRIX_ROWS];
+uint8_t gestureMode = GESTURE_MODE_ALONGSIDE;
+uint8_t gestureTapMax[MATRIX_KEYS];
+uint8_t gestureDoubleGap[MATRIX_KEYS];
+uint8_t gestureLongPress[MATRIX_KEYS];
+
+static GestureSlot slots[GESTURE_SLOTS];
+
+void setupGestures() {
+  for (uint8_t row = 0; row < MATRIX_ROWS; row++) {
+    gestureMask[row] = 0;
+  }
+  
+  for (uint8_t i = 0; i < MATRIX_KEYS; i++) {
+    gestureTapMax[i] = DEFAULT_TAP_MAX;
+    gestureDoubleGap[i] = DEFAULT_DOUBLE_GAP;
+    gestureLongPress[i] = DEFAULT_LONG_PRESS;
+  }
+  
+  for (uint8_t i = 0; i < GESTURE_SLOTS; i++) {
+    slots[i].state = GESTURE_FREE;
+  }
+}
+
+static GestureSlot* findSlot(uint8_t keyIndex) {
+  for (uint8_t i = 0; i < GESTURE_SLOTS; i++) {
+    if (slots[i].state != GESTURE_FREE && slots[i].keyIndex == keyIndex) {
+      return &slots[i];
+    }
+  }
+  return NULL;
+}
+
+static GestureSlot* allocateSlot(uint8_t keyIndex) {
+  for (uint8_t i = 0; i < GESTURE_SLOTS; i++) {
+    if (slots[i].state == GESTURE_FREE) {
+      slots[i].keyIndex = keyIndex;
+      return &slots[i];
+    }
+  }
+  return NULL;
+}
+
+static uint16_t thresholdMs(uint8_t units) {
+  return (uint16_t)units * GESTURE_TIME_UNIT_MS;
+}
+
+bool gestureKeyEdge(uint8_t keyIndex, bool keyPressed) {
+  uint8_t row = keyIndex / MATRIX_COLS;
+  uint8_t col = keyIndex % MATRIX_COLS;
+  
+  if (!(gestureMask[row] & ((uint16_t)1 << col))) {
+    return true;
+  }
+  
+  uint16_t currentTick = (uint16_t)millis();
+  GestureSlot* slot = findSlot(keyIndex);
+  
+  if (keyPressed) {
+    if (slot != NULL && slot->state == GESTURE_WAIT_SECOND) {
+      addKeyChange(keyIndex, KEY_EVENT_DOUBLE_TAP);
+      slot->state = GESTURE_SECOND_DOWN;
+    } else {
+      if (slot == NULL) {
+        slot = allocateSlot(keyIndex);
+      }
+      if (slot == NULL) {
+        return true;  // Out of slots, this press and its release go out raw
+      }
+      slot->state = GESTURE_FIRST_DOWN;
+    }
+    slot->tick = currentTick;
+  } else {
+    if (slot == NULL) {
+      return true;  // The press was not tracked either
+    }
+    
+    if (slot->state == GESTURE_FIRST_DOWN && gestureTapMax[keyIndex] != 0 &&
+        (uint16_t)(currentTick - slot->tick) <= thresholdMs(gestureTapMax[keyIndex])) {
+      if (gestureDoubleGap[keyIndex] == 0) {
+        addKeyChange(keyIndex, KEY_EVENT_TAP);  // No double-tap to wait for
+        slot->state = GESTURE_FREE;
+      } else {
+        slot->state = GESTURE_WAIT_SECOND;
+        slot->tick = currentTick;
+      }
+    } else {
+      slot->state = GESTURE_FREE;
+    }
+  }
+  
+  return gestureMode == GESTURE_MODE_ALONGSIDE;
+}
+
+void updateGestures() {
+  uint16_t currentTick = (uint16_t)millis();
+  
+  for (uint8_t i = 0; i < GESTURE_SLOTS; i++) {
+    GestureSlot* slot = &slots[i];
+    uint16_t elapsed = (uint16_t)(currentTick - slot->tick);
+    
+    if (slot->state == GESTURE_FIRST_DOWN) {
+      uint8_t longPress = gestureLongPress[slot->keyIndex];
+      if (longPress != 0 && elapsed >= thresholdMs(longPress)) {
+        addKeyChange(slot->keyIndex, KEY_EVENT_LONG_PRESS);
+        slot->state = GESTURE_LONG_HELD;
+      }
+    } else if (slot->state == GESTURE_WAIT_SECOND) {
+      if (elapsed > thresholdMs(gestureDoubleGap[slot->keyIndex])) {
+        addKeyChange(slot->keyIndex, KEY_EVENT_TAP);
+        slot->state = GESTURE_FREE;
+      }
+    }
+  }
+}
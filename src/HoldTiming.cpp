@@ -0,0 +1,114 @@
+#include "HoldTiming.h"
+#include "KeyEvents.h"
+#include "Matrix.h"
+#include "Utils.h"
+
+//================================
+// HOLD TIMING STATE
+//================================
+
+bool holdReporting = false;
+uint8_t stuckLimit = 0;
+bool stuckMasking = false;
+
+static uint16_t keyPressTick[MATRIX_KEYS];    // Low 16 bits of millis() at the press
+static uint16_t holdOverLimit[MATRIX_ROWS];   // 1 = held past HOLD_LIMIT_MS
+static uint16_t stuckKeys[MATRIX_ROWS];       // 1 = held past stuckLimit, reported
+static uint16_t stuckMasked[MATRIX_ROWS];     // 1 = already released by masking
+
+void setupHoldTiming() {
+  for (uint8_t row = 0; row < MATRIX_ROWS; row++) {
+    holdOverLimit[row] = 0;
+    stuckKeys[row] = 0;
+    stuckMasked[row] = 0;
+  }
+  holdReporting = false;
+  stuckLimit = 0;
+  stuckMasking = false;
+}
+
+void startHoldTimers() {
+  uint16_t currentTick = (uint16_t)millis();
+  
+  for (uint8_t i = 0; i < MATRIX_KEYS; i++) {
+    keyPressTick[i] = currentTick;
+  }
+}
+
+void holdKeyPressed(uint8_t keyIndex) {
+  keyPressTick[keyIndex] = (uint16_t)millis();
+  holdOverLimit[keyIndex / MATRIX_COLS] &= ~((uint16_t)1 << (keyIndex % MATRIX_COLS));
+}
+
+// holdOverLimit stays set until the next press, getHoldTime() still needs it
+bool holdKeyReleased(uint8_t keyIndex) {
+  uint8_t row = keyIndex / MATRIX_COLS;
+  uint16_t mask = (uint16_t)1 << (keyIndex % MATRIX_COLS);
+  
+  stuckKeys[row] &= ~mask;
+  if (stuckMasked[row] & mask) {
+    stuckMasked[row] &= ~mask;
+    return false;
+  }
+  return true;
+}
+
+// Flag keys held past stuckLimit, once per hold
+static void updateStuckKeys(uint16_t currentTick) {
+  uint16_t limit = (uint16_t)stuckLimit * 1000;
+  
+  for (uint8_t row = 0; row < MATRIX_ROWS; row++) {
+    uint16_t held = keyCurrent[row] & ~stuckKeys[row];
+    
+    for (uint8_t col = 0; held != 0; col++, held >>= 1) {
+      uint8_t keyIndex = row * MATRIX_COLS + col;
+      uint16_t mask = (uint16_t)1 << col;
+      
+      if (!(held & 1) ||
+          ((uint16_t)(currentTick - keyPressTick[keyIndex]) < limit && !(holdOverLimit[row] & mask))) {
+        continue;
+      }
+      
+      stuckKeys[row] |= mask;
+      if (keyEventMask[row] & mask) {
+        addKeyChange(keyIndex, KEY_EVENT_STUCK);
+      }
+      if (stuckMasking) {
+        stuckMasked[row] |= mask;
+        processKeyEdge(keyIndex, false);
+      }
+      debugPrintf("[KEY] %d stuck", keyNumberForIndex(keyIndex));
+    }
+  }
+}
+
+// Flag held keys before their 16-bit press tick can wrap
+void updateHoldTimers() {
+  uint16_t currentTick = (uint16_t)millis();
+  
+  for (uint8_t row = 0; row < MATRIX_ROWS; row++) {
+    uint16_t held = keyCurrent[row] & ~holdOverLimit[row];
+    
+    for (uint8_t col = 0; held != 0; col++, held >>= 1) {
+      if ((held & 1) &&
+          (uint16_t)(currentTick - keyPressTick[row * MATRIX_COLS + col]) >= HOLD_LIMIT_MS) {
+        holdOverLimit[row] |= (uint16_t)1 << col;
+      }
+    }
+  }
+  
+  if (stuckLimit != 0) {
+    updateStuckKeys(currentTick);
+  }
+}
+
+uint16_t getHoldTime(uint8_t keyIndex) {
+  uint8_t row = keyIndex / MATRIX_COLS;
+  uint8_t col = keyIndex % MATRIX_COLS;
+  uint16_t holdTime = (uint16_t)((uint16_t)millis() - keyPressTick[keyIndex]);
+  
+  if ((holdOverLimit[row] & ((uint16_t)1 << col)) || holdTime > HOLD_LIMIT_MS) {
+    return 0xFFFF;
+  }
+  return holdTime;
+}
@@ -0,0 +1,34 @@
+#include "Keymap.h"
+
+//================================
+// KEYMAP
+//================================
+
+// === Factory Default ===
+const uint16_t defaultKeymap[MATRIX_KEYS] PROGMEM = {
+  401, 402, 403, 404, 405, 406, 407, 408, 409, 410,
+  301, 302, 303, 304, 305, 306, 307, 308, 309, 310,
+  201, 202, 203, 204, 205, 206, 207, 208, 209, 210,
+  101, 102, 103, 104, 105, 106, 107, 108, 109, 110
+};
+
+uint16_t keymap[KEYMAP_LAYERS][MATRIX_KEYS];
+
+static void resetLayer(uint8_t layer) {
+  if (layer == 0) {
+    memcpy_P(keymap[0], defaultKeymap, sizeof(keymap[0]));
+  } else {
+    memset(keymap[layer], 0, sizeof(keymap[layer]));  // Falls through to layer 0
+  }
+}
+
+void resetKeymap() {
+  for (uint8_t layer = 0; layer < KEYMAP_LAYERS; layer++) {
+    resetLayer(layer);
+  }
+}
+
+uint16_t keymapLookup(uint8_t layer, uint8_t keyIndex) {
+  uint16_t keyNumber = keymap[layer][keyIndex];
+  return (keyNumber != 0) ? keyNumber : keymap[0][keyIndex];
+}
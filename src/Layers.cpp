@@ -0,0 +1,119 @@
+#include "Layers.h"
+#include "Utils.h"
+
+//================================
+// LAYER STATE
+//================================
+
+LayerModifier layerModifiers[LAYER_MODIFIER_SLOTS];
+
+#define NO_TOGGLED_SLOT 0xFF
+
+static uint8_t momentaryHeld = 0;    // Bit n = modifier slot n is held
+static uint8_t toggledSlot = NO_TOGGLED_SLOT;   // Slot whose layer is toggled on
+static uint8_t activeLayer = 0;
+static uint8_t keyLayer[MATRIX_KEYS];
+static uint8_t modifierDown[(MATRIX_KEYS + 7) / 8];   // Bit n = key n went down as a modifier
+
+void setupLayers() {
+  for (uint8_t i = 0; i < LAYER_MODIFIER_SLOTS; i++) {
+    layerModifiers[i].mode = LAYER_MODE_NONE;
+  }
+  for (uint8_t i = 0; i < MATRIX_KEYS; i++) {
+    keyLayer[i] = 0;
+  }
+  for (uint8_t i = 0; i < sizeof(modifierDown); i++) {
+    modifierDown[i] = 0;
+  }
+  momentaryHeld = 0;
+  toggledSlot = NO_TOGGLED_SLOT;
+  activeLayer = 0;
+}
+
+// Held momentary layers win over the toggled one, the highest layer first
+static void updateActiveLayer() {
+  uint8_t layer = 0;
+  
+  for (uint8_t i = 0; i < LAYER_MODIFIER_SLOTS; i++) {
+    if ((momentaryHeld & (1 << i)) && layerModifiers[i].layer > layer) {
+      layer = layerModifiers[i].layer;
+    }
+  }
+  if (layer == 0 && toggledSlot != NO_TOGGLED_SLOT) {
+    layer = layerModifiers[toggledSlot].layer;
+  }
+  activeLayer = layer;
+}
+
+bool setLayerModifier(uint8_t slot, uint8_t keyIndex, uint8_t mode, uint8_t layer) {
+  if (slot >= LAYER_MODIFIER_SLOTS || keyIndex >= MATRIX_KEYS || mode > LAYER_MODE_TOGGLE ||
+      layer == 0 || layer >= KEYMAP_LAYERS) {
+    return false;
+  }
+  
+  LayerModifier* modifier = &layerModifiers[slot];
+  if (modifier->keyIndex == keyIndex && modifier->mode == mode && modifier->layer == layer) {
+    return true;  // Unchanged, a toggled layer stays on
+  }
+  
+  // Whatever the old assignment had switched on goes off with it
+  modifier->keyIndex = keyIndex;
+  modifier->mode = mode;
+  modifier->layer = layer;
+  momentaryHeld &= ~(1 << slot);
+  if (toggledSlot == slot) {
+    toggledSlot = NO_TOGGLED_SLOT;
+  }
+  updateActiveLayer();
+  return true;
+}
+
+bool layerKeyEdge(uint8_t keyIndex, bool keyPressed) {
+  uint8_t* down = &modifierDown[keyIndex >> 3];
+  uint8_t bit = 1 << (keyIndex & 7);
+  
+  // A release goes the way its press went, the key may have been made or
+  // unmade a modifier while it was held
+  if (!keyPressed && !(*down & bit)) {
+    return true;
+  }
+  
+  bool isModifier = false;
+  
+  for (uint8_t i = 0; i < LAYER_MODIFIER_SLOTS; i++) {
+    LayerModifier* modifier = &layerModifiers[i];
+    if (modifier->mode == LAYER_MODE_NONE || modifier->keyIndex != keyIndex) {
+      continue;
+    }
+    
+    isModifier = true;
+    if (modifier->mode == LAYER_MODE_MOMENTARY) {
+      if (keyPressed) {
+        momentaryHeld |= 1 << i;
+      } else {
+        momentaryHeld &= ~(1 << i);
+      }
+    } else if (keyPressed) {
+      bool sameLayer = toggledSlot != NO_TOGGLED_SLOT && layerModifiers[toggledSlot].layer == modifier->layer;
+      toggledSlot = sameLayer ? NO_TOGGLED_SLOT : i;
+    }
+  }
+  
+  if (keyPressed && !isModifier) {
+    keyLayer[keyIndex] = activeLayer;
+    return true;
+  }
+  
+  if (keyPressed) {
+    *down |= bit;
+  } else {
+    *down &= ~bit;
+  }
+  updateActiveLayer();
+  debugPrintf("[LAYER] Active layer %d", activeLayer);
+  return false;
+}
+
+uint8_t getKeyLayer(uint8_t keyIndex) {
+  return keyLayer[keyIndex];
+}
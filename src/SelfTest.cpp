@@ -0,0 +1,101 @@
+#include "SelfTest.h"
+#include "Matrix.h"
+#include "Utils.h"
+
+//================================
+// SELF-TEST RESULT
+//================================
+
+uint8_t rowFaults = 0;
+uint16_t columnFaults = 0;
+uint16_t closedAtTest[MATRIX_ROWS];
+
+// Row lines A0-A3 (PC0-PC3), 1 = low
+static uint8_t readRowLines() {
+  return ~PINC & ((1 << MATRIX_ROWS) - 1);
+}
+
+void runSelfTest() {
+  uint8_t rowsLow[MATRIX_ROWS];      // Other rows pulled low by each driven row
+  uint16_t columnsLow[MATRIX_COLS];  // Other columns pulled low by each driven column
+  
+  for (uint8_t r = 0; r < MATRIX_ROWS; r++) {
+    pinMode(rowPins[r], INPUT_PULLUP);
+  }
+  for (uint8_t c = 0; c < MATRIX_COLS; c++) {
+    pinMode(colPins[c], INPUT_PULLUP);
+  }
+  delayMicroseconds(SELF_TEST_SETTLE_US);
+  
+  // Nothing driven, every line should read high
+  uint8_t groundedRows = readRowLines();
+  uint16_t groundedColumns = readColumns();
+  
+  for (uint8_t row = 0; row < MATRIX_ROWS; row++) {
+    pinMode(rowPins[row], OUTPUT);
+    digitalWrite(rowPins[row], LOW);
+    delayMicroseconds(SELF_TEST_SETTLE_US);
+    closedAtTest[row] = readColumns() & ~groundedColumns;
+    rowsLow[row] = readRowLines() & ~groundedRows & ~(uint8_t)(1 << row);
+    pinMode(rowPins[row], INPUT_PULLUP);
+  }
+  
+  for (uint8_t col = 0; col < MATRIX_COLS; col++) {
+    pinMode(colPins[col], OUTPUT);
+    digitalWrite(colPins[col], LOW);
+    delayMicroseconds(SELF_TEST_SETTLE_US);
+    columnsLow[col] = readColumns() & ~groundedColumns & ~((uint16_t)1 << col);
+    pinMode(colPins[col], INPUT_PULLUP);
+  }
+  
+  rowFaults = groundedRows;
+  columnFaults = groundedColumns;
+  
+  // Two closed keys sharing a line connect the other two lines, only
+  // connections no pair of closed keys explains are shorts
+  for (uint8_t row = 0; row < MATRIX_ROWS; row++) {
+    uint8_t explained = 0;
+    for (uint8_t other = 0; other < MATRIX_ROWS; other++) {
+      if (closedAtTest[row] & closedAtTest[other]) {
+        explained |= (uint8_t)(1 << other);
+      }
+    }
+    uint8_t shorted = rowsLow[row] & ~explained;
+    if (shorted) {
+      rowFaults |= shorted | (uint8_t)(1 << row);
+    }
+  }
+  
+  for (uint8_t col = 0; col < MATRIX_COLS; col++) {
+    uint16_t mask = (uint16_t)1 << col;
+    uint16_t explained = 0;
+    for (uint8_t row = 0; row < MATRIX_ROWS; row++) {
+      if (closedAtTest[row] & mask) {
+        explained |= closedAtTest[row];
+      }
+    }
+    uint16_t shorted = columnsLow[col] & ~explained;
+    if (shorted) {
+      columnFaults |= shorted | mask;
+    }
+  }
+  
+  // Faulty rows stay inputs, driving one against a short would fight it
+  for (uint8_t r = 0; r < MATRIX_ROWS; r++) {
+    if (!(rowFaults & (1 << r))) {
+      digitalWrite(rowPins[r], HIGH);
+      pinMode(rowPins[r], OUTPUT);
+    }
+  }
+  
+  if (rowFaults || columnFaults) {
+    debugPrintf("[SELFTEST] Faulty rows 0x%02X, columns 0x%03X", rowFaults, columnFaults);
+  }
+}
+
+uint16_t selfTestGoodKeys(uint8_t row) {
+  if (rowFaults & (1 << row)) {
+    return 0;
+  }
+  return ~columnFaults & ((1 << MATRIX_COLS) - 1);
+}
@@ -0,0 +1,54 @@
+#include "StackMonitor.h"
+
+//================================
+// STACK PAINTING
+//================================
+
+#define STACK_CANARY 0xC5
+
+extern uint8_t _end;      // End of .bss, provided by the linker
+extern uint8_t __stack;   // Top of RAM, where the stack starts
+
+static uint16_t stackFreeLowWater = 0;
+
+// Runs from .init3: SP and r1 are set up but nothing has been pushed yet and
+// .data/.bss are not initialized, so the loop must not touch the stack.
+void paintStack() __attribute__((naked, used, section(".init3")));
+void paintStack() {
+  __asm__ volatile (
+    "    ldi r30, lo8(_end)    \n"
+    "    ldi r31, hi8(_end)    \n"
+    "    ldi r24, %0           \n"
+    "    ldi r25, hi8(__stack) \n"
+    "    rjmp 2f               \n"
+    "1:  st Z+, r24            \n"
+    "2:  cpi r30, lo8(__stack) \n"
+    "    cpc r31, r25          \n"
+    "    brlo 1b               \n"
+    "    breq 1b               \n"
+    :: "i" (STACK_CANARY)
+  );
+}
+
+void updateStackWatermark() {
+  // Untouched canaries run upwards from the end of .bss (no heap is used)
+  const uint8_t* p = &_end;
+  while (p <= &__stack && *p == STACK_CANARY) {
+    p++;
+  }
+  
+  uint16_t freeBytes = (uint16_t)(p - &_end);
+  
+  // Read from the TWI ISR, so update the 16-bit value atomically
+  noInterrupts();
+  stackFreeLowWater = freeBytes;
+  interrupts();
+}
+
+uint16_t getStackFreeLowWater() {
+  return stackFreeLowWater;
+}
+
+uint16_t getStackRegionSize() {
+  return (uint16_t)(&__stack - &_end + 1);
+}
@@ -0,0 +1,121 @@
+#include "UartTransport.h"
+#include <util/crc16.h>
+
+//================================
+// FRAMING
+//================================
+
+#define UART_CRC_BYTES 2
+#define UART_FRAME_OVERHEAD (UART_CRC_BYTES + 2)   // CRC, COBS code byte, delimiter
+#define UART_RX_BUFFER_SIZE (UART_MAX_PAYLOAD + UART_CRC_BYTES + 1)
+
+static uint8_t rxBuffer[UART_RX_BUFFER_SIZE];
+static uint8_t rxLength = 0;
+static bool rxOverflow = false;   // Drop bytes until the next delimiter
+
+void setupUartTransport() {
+  Serial.begin(UART_BAUD);
+  rxLength = 0;
+  rxOverflow = false;
+}
+
+static uint16_t frameCrc(const uint8_t* data, uint8_t length) {
+  uint16_t crc = 0xFFFF;
+  for (uint8_t i = 0; i < length; i++) {
+    crc = _crc_xmodem_update(crc, data[i]);
+  }
+  return crc;
+}
+
+bool uartCanSend(uint8_t length) {
+  return Serial.availableForWrite() >= length + UART_FRAME_OVERHEAD;
+}
+
+void uartSendFrame(const uint8_t* frame, uint8_t length) {
+  uint8_t packet[UART_MAX_PAYLOAD + UART_FRAME_OVERHEAD];
+  uint16_t crc = frameCrc(frame, length);
+  
+  // COBS: every zero is replaced by the distance to the next one, the
+  // payload is short enough that a block never reaches 254 bytes
+  uint8_t codeIndex = 0;
+  uint8_t code = 1;
+  uint8_t packetLength = 1;
+  
+  for (uint8_t i = 0; i < length + UART_CRC_BYTES; i++) {
+    uint8_t value;
+    if (i < length) {
+      value = frame[i];
+    } else {
+      value = (i == length) ? (uint8_t)(crc >> 8) : (uint8_t)crc;
+    }
+    
+    if (value == 0) {
+      packet[codeIndex] = code;
+      codeIndex = packetLength++;
+      code = 1;
+    } else {
+      packet[packetLength++] = value;
+      code++;
+    }
+  }
+  packet[codeIndex] = code;
+  packet[packetLength++] = 0;   // Frame delimiter
+  
+  Serial.write(packet, packetLength);
+}
+
+// Decode a COBS packet in place, returns the decoded length or 0 if malformed
+static uint8_t cobsDecode(uint8_t* data, uint8_t length) {
+  uint8_t in = 0;
+  uint8_t out = 0;
+  
+  while (in < length) {
+    uint8_t code = data[in++];
+    if (code == 0 || in + code - 1 > length) {
+      return 0;
+    }
+    for (uint8_t i = 1; i < code; i++) {
+      data[out++] = data[in++];
+    }
+    if (code < 0xFF && in < length) {
+      data[out++] = 0;
+    }
+  }
+  return out;
+}
+
+bool uartReceiveCommand(uint8_t* command, uint8_t* length) {
+  while (Serial.available()) {
+    uint8_t value = Serial.read();
+    
+    if (value != 0) {
+      if (rxLength < UART_RX_BUFFER_SIZE) {
+        rxBuffer[rxLength++] = value;
+      } else {
+        rxOverflow = true;
+      }
+      continue;
+    }
+    
+    // Delimiter: decode and check what was collected
+    uint8_t received = rxOverflow ? 0 : cobsDecode(rxBuffer, rxLength);
+    rxLength = 0;
+    rxOverflow = false;
+    
+    if (received <= UART_CRC_BYTES) {
+      continue;
+    }
+    
+    uint8_t payload = received - UART_CRC_BYTES;
+    uint16_t crc = ((uint16_t)rxBuffer[payload] << 8) | rxBuffer[payload + 1];
+    if (crc != frameCrc(rxBuffer, payload)) {
+      continue;
+    }
+    
+    memcpy(command, rxBuffer, payload);
+    *length = payload;
+    return true;
+  }
+  
+  return false;
+}
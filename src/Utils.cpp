@@ -3,6 +3,10 @@
 //================================
 // DEBUG SETTINGS
 //================================
+#if defined(DEBUG) && defined(UART_TRANSPORT)
+  #error "Debug output and the UART transport both use Serial"
+#endif
+
 #ifdef DEBUG
   bool debugMode = true;  // Enables or disables verbose serial output
 #else
@@ -15,23 +19,23 @@
 //================================
 
 
-void debugPrint(const char* message) {
+void debugPrint_P(PGM_P message) {
   if (debugMode) {
-    Serial.println(message);
+    Serial.println((const __FlashStringHelper*)message);
   }
 }
 
-void debugPrintf(const char* format, ...) {
+void debugPrintf_P(PGM_P format, ...) {
   if (debugMode) {
-    char buffer[128];
+    char buffer[80];
     va_list args;
     va_start(args, format);
-    vsnprintf(buffer, sizeof(buffer), format, args);
+    vsnprintf_P(buffer, sizeof(buffer), format, args);
     va_end(args);
     
     // Check if the format string already ends with a newline
-    size_t len = strlen(format);
-    if (len > 0 && format[len-1] == '\n') {
+    size_t len = strlen_P(format);
+    if (len > 0 && pgm_read_byte(format + len - 1) == '\n') {
       Serial.print(buffer); // Already has newline
     } else {
       Serial.println(buffer); // Add newline
@@ -5,97 +5,505 @@
 
 #include <Arduino.h>
 #include <Wire.h>
+#include <avr/eeprom.h>
+#include "AnalogInputs.h"
+#include "AutoRepeat.h"
+#include "Chords.h"
+#include "ConfigStore.h"
+#include "Debounce.h"
+#include "EdgeClock.h"
+#include "Encoder.h"
+#include "Gestures.h"
+#include "HoldTiming.h"
+#include "KeyboardConfig.h"
+#include "KeyEvents.h"
+#include "Keymap.h"
+#include "Layers.h"
+#include "Matrix.h"
+#include "SelfTest.h"
+#include "StackMonitor.h"
+#include "UartTransport.h"
 #include "Utils.h"
 
 // === Configuration ===
-#define I2C_ADDRESS 0x10        
-#define MATRIX_ROWS 4           
-#define MATRIX_COLS 10          
-#define DEBOUNCE_MS 20          
-#define CHANGE_BUFFER_SIZE 8    // Small buffer for multiple keypresses
+#define I2C_ADDRESS 0x10        // Default, the stored address is used once saved
+#define I2C_ADDRESS_MIN 0x08    // 7-bit addresses outside this range are reserved
+#define I2C_ADDRESS_MAX 0x77
+#define DEBOUNCE_MS 20          // Default upper bound of the per-key debounce windows
+#define DEBOUNCE_SAVE_INTERVAL_MS 3600000UL  // Tuned windows are saved at most hourly
+#define SCAN_INTERVAL_MS 2      // Default pause between scans
+#define SCAN_INTERVAL_MAX_MS 20
+#define CHANGE_BUFFER_SIZE 16   // Buffer for multiple keypresses (power of two)
+#define PRIORITY_BUFFER_SIZE 4  // Separate buffer for priority keys (power of two)
+#define HISTORY_SIZE 8          // Delivered changes kept for resend (power of two)
+#define COALESCE_MAX_MS 20      // Longest hold-off the master can set
+#define COALESCE_SETTLE_MS 2    // A burst has settled after this long without a new change
+#define STALE_CHANGE_MS 100     // Changes not collected by the master within this are dropped
+#define STACK_CHECK_INTERVAL_MS 250
+#define HOLD_CHECK_INTERVAL_MS 1000
+#define BOOT_SETTLE_SAMPLES 5     // Identical matrix reads 1ms apart for a settled boot snapshot
+#define BOOT_SETTLE_MAX_READS 50  // Give up waiting for a settled matrix after this many
+#define BOOT_EPOCH_EEPROM_ADDR 0x3FE  // Boot counter, last two bytes of EEPROM
+#define SETTINGS_EEPROM_ADDR 0x000    // Two slots of the settings record
+#define SETTINGS_EEPROM_SIZE 0x380
+#define TUNING_EEPROM_ADDR 0x380      // Two slots of the tuned debounce windows
+#define TUNING_EEPROM_SIZE (BOOT_EPOCH_EEPROM_ADDR - TUNING_EEPROM_ADDR)
 
 // === Protocol Constants ===
 #define DATA_TYPE_KEYPRESS 0x02  
+#define FRAME_MAX_LENGTH BUFFER_LENGTH   // Limited by the Wire transmit buffer
+#define KEYPRESS_RECORD_SIZE 3   // Key number high, low, event
+#define CHORD_RECORD_SIZE (3 + CHORD_MASK_BYTES)  // 0, 0, event, key bitmask
+#define HOLD_RECORD_SIZE 5       // Key number high, low, event, hold time high, low
+#define ENCODER_RECORD_SIZE 5    // 0, encoder, event, signed detents high, low
+#define DATA_TYPE_KEYMAP 0x03
+#define MAX_KEYMAP_ENTRIES_PER_FRAME ((FRAME_MAX_LENGTH - 3) / 2)
+#define DATA_TYPE_STATUS 0x04
+#define DATA_TYPE_SNAPSHOT 0x05
+#define DATA_TYPE_KEYPRESS_SEQ 0x06  // Keypress frame with the sequence number of its first change
+#define DATA_TYPE_HISTORY 0x07       // Same layout, resent from the history
+#define DATA_TYPE_INITIAL_STATE 0x08 // Sent once after boot: boot epoch, then pressed bitmap per row
+#define DATA_TYPE_ANALOG 0x09        // A6 and A7 values (high, low), sent when one of them changed
+#define DATA_TYPE_FAULTS 0x0A        // Self-test result: row faults, column faults, closed keys per row
+#define DATA_TYPE_TIMED 0x80         // Set on keypress and history types when records carry edge times
+#define EDGE_TIME_SIZE 2             // Low 16 bits of the edge clock after each record
+#define EDGE_AGE_MAX 0xFFFF          // us, older records are sent as this old
+#define FRAME_CLOCK_SIZE 4           // Edge clock at frame build time
+
+// === Commands (master write: command byte followed by arguments) ===
+#define CMD_KEYMAP_WRITE 0x10   // start index (layer in bits 6-7), then key number high/low pairs
+#define CMD_KEYMAP_READ  0x11   // start index (layer in bits 6-7); next read returns a keymap frame
+#define CMD_CONFIG_SAVE  0x12   // persist all settings (keymap, masks, timings) to EEPROM
+#define CMD_KEYMAP_RESET 0x13   // restore the factory keymap in RAM
+#define CMD_I2C_ADDRESS  0x14   // 7-bit address, used after the next save and reset
+#define CMD_DEBOUNCE     0x15   // fixed window in ms, or lower and upper bound for tuning (1-255)
+#define CMD_SCAN_INTERVAL 0x16  // pause between scans in ms (0 to SCAN_INTERVAL_MAX_MS)
+#define CMD_MAJORITY_VOTE 0x17  // 1 = each row is read three times and voted per column, 0 = read once
+#define CMD_STATUS_READ  0x20   // next read returns a status frame
+#define CMD_SNAPSHOT_READ 0x21  // next read returns the debounced state of every key
+#define CMD_HISTORY_READ 0x22   // sequence N; next read returns delivered changes after N
+#define CMD_RETRANSMIT   0x23   // next read returns the previous frame again, byte for byte
+#define CMD_SELF_TEST    0x24   // rerun the matrix self-test; the first read after it returns a fault frame
+#define CMD_FAULT_READ   0x25   // next read returns the fault frame of the last self-test
+#define CMD_REPEAT_CONFIG 0x30  // delay high/low, interval high/low (ms)
+#define CMD_REPEAT_MASK  0x31   // high/low column bitmap for each row, 1 = key repeats
+#define CMD_GESTURE_MASK 0x32   // high/low column bitmap for each row, 1 = key is classified
+#define CMD_GESTURE_MODE 0x33   // GESTURE_MODE_ALONGSIDE or GESTURE_MODE_INSTEAD
+#define CMD_GESTURE_TIMING 0x34 // start index, then tap/double-gap/long-press triples (10ms units)
+#define CMD_CHORD_MASK   0x35   // high/low column bitmap for each row, 1 = key can be in a chord
+#define CMD_CHORD_WINDOW 0x36   // window in ms, 0 = off
+#define CMD_LAYER_KEY    0x37   // slot, key index, mode (LAYER_MODE_*), layer
+#define CMD_HOLD_REPORT  0x38   // 1 = releases carry the hold time, 0 = plain releases
+#define CMD_ENABLE_MASK  0x39   // high/low column bitmap for each row, 0 = key is not scanned
+#define CMD_EVENT_MASK   0x3A   // high/low column bitmap for each row, 0 = key only shows in snapshots
+#define CMD_PRIORITY_MASK 0x3B  // high/low column bitmap for each row, 1 = priority key
+#define CMD_SEQUENCE_MODE 0x3C  // 1 = send DATA_TYPE_KEYPRESS_SEQ frames, 0 = plain frames
+#define CMD_COALESCE     0x3D   // hold-off in ms (0 = off, at most COALESCE_MAX_MS)
+#define CMD_STUCK_KEY    0x3E   // limit in s (0 = off, at most STUCK_LIMIT_MAX_S), 1 = mask stuck keys
+#define CMD_TIMESTAMPS   0x3F   // 1 = frames carry the clock and records their edge time, 0 = plain
 
 // === Pin Definitions ===
 const uint8_t rowPins[MATRIX_ROWS] = {A0, A1, A2, A3};           
 const uint8_t colPins[MATRIX_COLS] = {2, 3, 4, 5, 6, 7, 8, 9, 11, 12}; 
 
-// === Key Numbering Matrix ===
-const uint16_t keyNumbers[MATRIX_ROWS][MATRIX_COLS] = {
-  {401, 402, 403, 404, 405, 406, 407, 408, 409, 410},  
-  {301, 302, 303, 304, 305, 306, 307, 308, 309, 310},  
-  {201, 202, 203, 204, 205, 206, 207, 208, 209, 210},  
-  {101, 102, 103, 104, 105, 106, 107, 108, 109, 110}   
-};
-
-
-// === State Tracking Structure ===
-struct KeyState {
-  bool currentState;       
-  bool lastState;         
-  unsigned long lastChangeTime; 
-};
+// === Key State Store ===
+// One bitmap per row (bit n = column n) keeps the whole matrix in 16 bytes.
+// Debounce uses per-key 8-bit countdowns in milliseconds instead of absolute
+// timestamps, so they can never wrap: 0 means the key may change again.
+static_assert(MATRIX_COLS <= 16, "Row bitmaps are 16 bits wide");
 
 // === Circular Buffer Structure ===
+// The key is stored as its matrix index and only turned into a 101-410
+// key number when the I2C frame is assembled.
 struct KeyChange {
-  uint16_t keyNumber;     
-  uint8_t newState;       
-  unsigned long timestamp;
+  uint8_t keyIndex;       // row * MATRIX_COLS + col, layer in bits 6-7
+  uint8_t event;          // KEY_EVENT_*
+  uint16_t tick;          // Low 16 bits of millis(), compared wrap-safe
+  uint32_t edgeTime;      // Edge clock (us) when the row was sampled
+  uint16_t value;         // Hold time in ms (KEY_EVENT_RELEASED_HOLD), signed detents (KEY_EVENT_ENCODER)
 };
 
+static_assert((CHANGE_BUFFER_SIZE & (CHANGE_BUFFER_SIZE - 1)) == 0, "CHANGE_BUFFER_SIZE must be a power of two");
+static_assert((PRIORITY_BUFFER_SIZE & (PRIORITY_BUFFER_SIZE - 1)) == 0, "PRIORITY_BUFFER_SIZE must be a power of two");
+static_assert((HISTORY_SIZE & (HISTORY_SIZE - 1)) == 0, "HISTORY_SIZE must be a power of two");
+static_assert(CHORD_SLOTS >= CHANGE_BUFFER_SIZE + HISTORY_SIZE, "Every queued or kept record may be a chord (chords skip the priority buffer)");
+
 // === Global Variables ===
-KeyState keyStates[MATRIX_ROWS][MATRIX_COLS];
+uint16_t keyCurrent[MATRIX_ROWS];
+uint8_t keyDebounce[MATRIX_ROWS][MATRIX_COLS];    // Remaining lockout per key (ms)
+uint8_t lastScanTick = 0;                         // Low byte of millis() at the previous scan
+uint8_t scanIntervalMs = SCAN_INTERVAL_MS;
+uint8_t i2cAddress = I2C_ADDRESS;
+bool majorityVote = false;                        // Take each column's level from a 2-of-3 vote
+uint16_t keyEnableMask[MATRIX_ROWS];              // 0 = key is skipped by the scanner
+uint16_t keyEventMask[MATRIX_ROWS];
 KeyChange changeBuffer[CHANGE_BUFFER_SIZE];
 uint8_t bufferHead = 0;      // Where to write next change
 uint8_t bufferTail = 0;      // Where to read next change  
 uint8_t bufferCount = 0;     // How many changes are buffered
 
+// === Coalescing ===
+// With a hold-off set, polls see an empty frame while a burst is still
+// arriving, so related changes go out together
+uint8_t coalesceHoldoff = 0;       // ms, 0 = changes are sent as soon as they are queued
+uint16_t firstPendingTick = 0;     // When the buffer last went from empty to not empty
+uint16_t lastQueuedTick = 0;       // When the newest change was queued
+
+// === Priority Lane ===
+// Events of priority keys go to their own buffer, which is sent at the front
+// of every frame and never overwritten or expired. Only if it is full do they
+// fall back to the normal buffer.
+uint16_t priorityMask[MATRIX_ROWS];               // 1 = key uses the priority buffer
+KeyChange priorityBuffer[PRIORITY_BUFFER_SIZE];
+uint8_t priorityHead = 0;
+uint8_t priorityTail = 0;
+uint8_t priorityCount = 0;
+
+// === Delivery History ===
+// Every change written to a frame gets the next 8-bit sequence number and a
+// copy is kept, so the master can ask again for anything after sequence N.
+// Only touched from the TWI ISR.
+KeyChange historyBuffer[HISTORY_SIZE];
+uint8_t historyNextSeq = 0;    // Sequence number of the next delivered change
+uint8_t historyCount = 0;
+uint8_t historyQuerySeq = 0;   // N of the last history command
+bool sequencedFrames = false;
+
+// === Edge Timestamps ===
+// Edges are stamped when their row is read, events queued while an edge
+// is processed get that time, all others the time they are queued
+uint32_t rowSampleTime = 0;       // Edge clock right after the last row read
+uint32_t pendingEdgeTime = 0;
+bool edgeInProgress = false;
+uint32_t frameClock = 0;          // Edge clock written into the frame being built
+bool timestampedFrames = false;   // Send the DATA_TYPE_TIMED layouts
+bool frameTimed = false;          // Layout of the frame being built
+
+// === Hold Timing ===
+unsigned long lastHoldCheck = 0;
+
+// Statistics, saturate at 255
+uint8_t overflowCount = 0;   // Changes overwritten because the buffer was full
+uint8_t staleCount = 0;      // Changes dropped because the master did not collect them
+unsigned long lastStackCheck = 0;
+
+// === Boot ===
+bool keyboardReady = false;       // Set once the first scan has completed
+bool initialStatePending = false; // Next frame is the one-shot initial state frame
+uint16_t bootEpoch = 0;           // Boot counter, changes on every reset
+uint8_t bootEpochBytesPending = 0; // Epoch bytes still to be written to EEPROM
+uint16_t bootReadyMicros = 0;     // Reset to ready in us (micros() at the first completed scan)
+
+// === Self-Test ===
+volatile bool selfTestPending = false;            // Rerun requested by the master
+
+// === Frame and Command Buffers ===
+uint8_t frameBuffer[FRAME_MAX_LENGTH];   // Frame being sent, built by buildFrame()
+uint8_t frameLength = 0;
+const uint8_t* commandData = NULL;       // Command being handled
+uint8_t commandLength = 0;
+uint8_t commandPos = 0;
+
+volatile uint8_t pendingResponse = DATA_TYPE_KEYPRESS;  // Frame type for the next read
+volatile uint8_t keymapReadStart = 0;                   // First entry of the next keymap frame
+volatile bool retransmitPending = false;                // Resend frameBuffer as it is
+
+// === Stored Settings ===
+// Everything the master can configure, saved as one record by CMD_CONFIG_SAVE.
+// Adding or resizing an entry makes older records unreadable (defaults are used).
+const ConfigRegion configRegions[] PROGMEM = {
+  { &i2cAddress, sizeof(i2cAddress) },
+  { &debounceMin, sizeof(debounceMin) },
+  { &debounceMax, sizeof(debounceMax) },
+  { &scanIntervalMs, sizeof(scanIntervalMs) },
+  { &majorityVote, sizeof(majorityVote) },
+  { keymap, sizeof(keymap) },
+  { keyEnableMask, sizeof(keyEnableMask) },
+  { keyEventMask, sizeof(keyEventMask) },
+  { priorityMask, sizeof(priorityMask) },
+  { repeatMask, sizeof(repeatMask) },
+  { &repeatDelay, sizeof(repeatDelay) },
+  { &repeatInterval, sizeof(repeatInterval) },
+  { &holdReporting, sizeof(holdReporting) },
+  { &sequencedFrames, sizeof(sequencedFrames) },
+  { &timestampedFrames, sizeof(timestampedFrames) },
+  { &coalesceHoldoff, sizeof(coalesceHoldoff) },
+  { &stuckLimit, sizeof(stuckLimit) },
+  { &stuckMasking, sizeof(stuckMasking) },
+  { gestureMask, sizeof(gestureMask) },
+  { &gestureMode, sizeof(gestureMode) },
+  { gestureTapMax, sizeof(gestureTapMax) },
+  { gestureDoubleGap, sizeof(gestureDoubleGap) },
+  { gestureLongPress, sizeof(gestureLongPress) },
+  { chordMask, sizeof(chordMask) },
+  { &chordWindow, sizeof(chordWindow) },
+  { layerModifiers, sizeof(layerModifiers) }
+};
+
+// The tuned debounce windows change on their own, so they are saved
+// separately without also saving whatever the master has not saved yet
+const ConfigRegion tuningRegions[] PROGMEM = {
+  { debounceWindow, sizeof(debounceWindow) }
+};
+
+ConfigStore settingsStore;
+ConfigStore tuningStore;
+unsigned long lastTuningSave = 0;
+
 // === Function Declarations ===
+void finishBoot();
+void updateBootEpoch();
+void takeInitialSnapshot();
+uint16_t scanMask(uint8_t row);
+void releaseUnscannedKeys(uint8_t row, uint16_t enabled);
+void buildFaultFrame();
 void setupMatrix();
+uint16_t readRow(uint8_t row);
 void scanMatrix();
+void updateDebounceTimers(uint8_t elapsed);
+void readRowMasks(uint16_t* masks);
 void sendKeyboardData();
-void addKeyChange(uint16_t keyNumber, uint8_t newState);
+void frameWrite(uint8_t value);
+void frameWriteBytes(const uint8_t* data, uint8_t length);
+void buildFrame();
+void buildKeypressFrame();
+bool changesReady();
+uint8_t recordSize(const KeyChange* change);
+void writeRecord(const KeyChange* change);
+void writeRecordFields(const KeyChange* change);
+void writeFrameClock();
+void ageEdgeTimes();
+void buildKeymapFrame();
+void buildStatusFrame();
+void buildSnapshotFrame();
+void buildInitialStateFrame();
+void buildAnalogFrame();
+void buildHistoryFrame();
+void addToHistory(const KeyChange* change);
+void skipSequence();
+void receiveCommand(int byteCount);
+void serviceUartTransport();
+void handleCommand(const uint8_t* data, uint8_t length);
+int commandAvailable();
+int commandRead();
 uint8_t getBufferedChangeCount();
 bool getNextChange(KeyChange* change);
+const KeyChange* peekChange(uint8_t position);
 void clearStaleChanges();
 
 // === SETUP FUNCTION ===
+// Only what the first scan and the bus need runs here, the master may
+// already be polling after a joint power-on. The rest waits for finishBoot().
 void setup() {
-  Wire.begin(I2C_ADDRESS);       
-  Wire.onRequest(sendKeyboardData); 
-  
-  Serial.begin(57600);           
-  debugPrint("EvoFaderWing keyboard slave starting...");
-  debugPrintf("I2C Address: 0x%02X", I2C_ADDRESS);
-  
+  resetKeymap();
   setupMatrix();
   
   // Initialize all key states
   for (int row = 0; row < MATRIX_ROWS; row++) {
+    keyCurrent[row] = 0;
+    keyEnableMask[row] = (1 << MATRIX_COLS) - 1;
+    keyEventMask[row] = (1 << MATRIX_COLS) - 1;
+    priorityMask[row] = 0;
     for (int col = 0; col < MATRIX_COLS; col++) {
-      keyStates[row][col].currentState = false;     
-      keyStates[row][col].lastState = false;        
-      keyStates[row][col].lastChangeTime = 0;       
+      keyDebounce[row][col] = 0;
     }
   }
+  lastScanTick = (uint8_t)millis();
+  setupEdgeClock();
+  setupDebounce(DEBOUNCE_MS);
+  setupGestures();
+  setupChords();
+  setupAutoRepeat();
+  setupHoldTiming();
+  setupLayers();
+  
+  // Stored settings replace the defaults set above
+  setupConfigStore(&settingsStore, configRegions, sizeof(configRegions) / sizeof(configRegions[0]),
+                   SETTINGS_EEPROM_ADDR, SETTINGS_EEPROM_SIZE);
+  setupConfigStore(&tuningStore, tuningRegions, sizeof(tuningRegions) / sizeof(tuningRegions[0]),
+                   TUNING_EEPROM_ADDR, TUNING_EEPROM_SIZE);
+  loadConfig(&settingsStore);
+  loadConfig(&tuningStore);
+  setDebounceBounds(debounceMin, debounceMax);   // Bounds may have been saved after the windows
+  setRepeatTiming(repeatDelay, repeatInterval);
   
   // Initialize change buffer
   bufferHead = 0;
   bufferTail = 0;
   bufferCount = 0;
+  bootEpoch = eeprom_read_word((const uint16_t*)BOOT_EPOCH_EEPROM_ADDR) + 1;
+  
+  // The bus is up before the matrix work, polls get empty frames until
+  // finishBoot() marks the keyboard ready
+#ifdef UART_TRANSPORT
+  setupUartTransport();
+#else
+  Wire.begin(i2cAddress);       
+  Wire.onRequest(sendKeyboardData); 
+  Wire.onReceive(receiveCommand);
+#endif
+  
+  // Keys already held at boot start out pressed instead of sending a press
+  runSelfTest();
+  takeInitialSnapshot();
+  initialStatePending = true;
+  
+#ifdef ENCODER_INPUT
+  setupEncoder();
+#endif
+  
+#ifdef ANALOG_INPUT
+  setupAnalogInputs();
+#endif
+}
+
+// Runs once after the first complete scan, from then on key states are valid
+void finishBoot() {
+  unsigned long elapsed = micros();
+  bootReadyMicros = (elapsed > 0xFFFF) ? 0xFFFF : (uint16_t)elapsed;
+  keyboardReady = true;
+  
+#ifndef UART_TRANSPORT
+  Serial.begin(57600);           
+  debugPrint("EvoFaderWing keyboard slave starting...");
+  debugPrintf("I2C Address: 0x%02X", i2cAddress);
+#endif
+  debugPrintf("Ready %u us after reset", bootReadyMicros);
+  
+  // Written from the loop one byte at a time, an EEPROM write takes a few ms
+  bootEpochBytesPending = sizeof(bootEpoch);
+  debugPrintf("Boot epoch %u", bootEpoch);
+  
+  updateStackWatermark();
+  debugPrintf("Stack: %u of %u bytes free", getStackFreeLowWater(), getStackRegionSize());
   
   debugPrint("Matrix initialized, ready for scanning...");
 }
 
+// One byte of the boot epoch per call, only when the EEPROM is idle
+void updateBootEpoch() {
+  if (bootEpochBytesPending == 0 || !eeprom_is_ready()) {
+    return;
+  }
+  
+  bootEpochBytesPending--;
+  eeprom_update_byte((uint8_t*)BOOT_EPOCH_EEPROM_ADDR + bootEpochBytesPending,
+                     ((const uint8_t*)&bootEpoch)[bootEpochBytesPending]);
+}
+
+// Read the whole matrix until it stops changing and take that as the
+// debounced state, so held keys need no press event
+void takeInitialSnapshot() {
+  uint16_t sample[MATRIX_ROWS];
+  uint8_t stableReads = 0;
+  
+  for (uint8_t reads = 0; reads < BOOT_SETTLE_MAX_READS && stableReads < BOOT_SETTLE_SAMPLES; reads++) {
+    bool same = true;
+    
+    for (uint8_t row = 0; row < MATRIX_ROWS; row++) {
+      uint16_t levels = readRow(row);
+      if (reads == 0 || levels != sample[row]) {
+        same = false;
+      }
+      sample[row] = levels;
+    }
+    
+    stableReads = same ? stableReads + 1 : 0;
+    delay(1);
+  }
+  
+  for (uint8_t r = 0; r < MATRIX_ROWS; r++) {
+    digitalWrite(rowPins[r], HIGH);
+  }
+  
+  for (uint8_t row = 0; row < MATRIX_ROWS; row++) {
+    keyCurrent[row] = sample[row] & scanMask(row);
+  }
+  startHoldTimers();
+}
+
+// Keys of a row that are scanned: enabled by the master and on good lines
+uint16_t scanMask(uint8_t row) {
+  return keyEnableMask[row] & selfTestGoodKeys(row);
+}
+
+// Held keys that just left the scan mask are released the way a masked
+// stuck key is, so layers, chords, gestures and repeat all see them go
+void releaseUnscannedKeys(uint8_t row, uint16_t enabled) {
+  uint16_t dropped = keyCurrent[row] & ~enabled;
+  
+  for (uint8_t col = 0; dropped != 0; col++, dropped >>= 1) {
+    if (!(dropped & 1)) {
+      continue;
+    }
+    
+    uint8_t keyIndex = row * MATRIX_COLS + col;
+    uint16_t mask = (uint16_t)1 << col;
+    
+    keyCurrent[row] &= ~mask;
+    if (holdKeyReleased(keyIndex)) {
+      processKeyEdge(keyIndex, false);
+    }
+  }
+}
+
 // === MAIN LOOP ===
 void loop() {
   scanMatrix();        
   
+  if (selfTestPending) {
+    selfTestPending = false;
+    runSelfTest();
+    // Held keys on lines that just failed are released before anything else is queued
+    for (uint8_t row = 0; row < MATRIX_ROWS; row++) {
+      releaseUnscannedKeys(row, scanMask(row));
+    }
+    pendingResponse = DATA_TYPE_FAULTS;
+  }
+  
+  if (!keyboardReady) {
+    finishBoot();
+  }
+  
+#ifdef UART_TRANSPORT
+  serviceUartTransport();
+#endif
+  
+#ifdef ENCODER_INPUT
+  updateEncoder();
+#endif
+  
+#ifdef ANALOG_INPUT
+  updateAnalogInputs();
+#endif
+  
   // Clear stale changes if they've been sitting too long
   clearStaleChanges();
   
-  delay(2);  // Slower scanning - 2ms instead of 1ms
+  if (millis() - lastHoldCheck >= HOLD_CHECK_INTERVAL_MS) {
+    lastHoldCheck = millis();
+    updateHoldTimers();
+    ageEdgeTimes();
+  }
+  
+  if (millis() - lastStackCheck >= STACK_CHECK_INTERVAL_MS) {
+    lastStackCheck = millis();
+    updateStackWatermark();
+  }
+  
+  if (millis() - lastTuningSave >= DEBOUNCE_SAVE_INTERVAL_MS) {
+    lastTuningSave = millis();
+    if (takeDebounceTuningChanged()) {
+      saveConfig(&tuningStore);
+    }
+  }
+  
+  // One EEPROM byte at a time, only when the previous write has finished
+  updateConfigStore(&settingsStore);
+  updateConfigStore(&tuningStore);
+  updateBootEpoch();
+  
+  delay(scanIntervalMs);
 }
 
 // === MATRIX SETUP ===
@@ -112,37 +520,61 @@ void setupMatrix() {
 
 // === MATRIX SCANNING ===
 void scanMatrix() {
-  unsigned long currentTime = millis(); 
+  uint8_t currentTick = (uint8_t)millis();
+  updateDebounceTimers((uint8_t)(currentTick - lastScanTick));
+  lastScanTick = currentTick;
   
   // Scan each row
   for (int row = 0; row < MATRIX_ROWS; row++) {
-    // Set only current row LOW
-    for (int r = 0; r < MATRIX_ROWS; r++) {
-      digitalWrite(rowPins[r], (r == row) ? LOW : HIGH);
+    // Disabled keys and keys on faulty lines read as released and are never looked at
+    uint16_t enabled = scanMask(row);
+    releaseUnscannedKeys(row, enabled);
+    if (enabled == 0) {
+      continue;
     }
     
-    delayMicroseconds(10);
+    // Only columns whose sampled level differs from the debounced state matter
+    uint16_t changed = (readRow(row) ^ keyCurrent[row]) & enabled;
     
-    // Read all columns for current row
-    for (int col = 0; col < MATRIX_COLS; col++) {
-      bool keyPressed = (digitalRead(colPins[col]) == LOW);
+    for (int col = 0; changed != 0; col++, changed >>= 1) {
+      if (!(changed & 1)) {
+        continue;
+      }
+      if (keyDebounce[row][col] != 0) {
+        // Still locked out, this is the key bouncing
+        // The window may have been lowered since the lockout started
+        uint8_t bouncingKey = row * MATRIX_COLS + col;
+        uint8_t window = debounceWindow[bouncingKey];
+        uint8_t remaining = keyDebounce[row][col];
+        debounceBounce(bouncingKey, window > remaining ? window - remaining : 0);
+        continue;
+      }
       
-      // Debouncing
-      if (keyPressed != keyStates[row][col].currentState) {
-        if ((currentTime - keyStates[row][col].lastChangeTime) > DEBOUNCE_MS) {
-          keyStates[row][col].lastState = keyStates[row][col].currentState;
-          keyStates[row][col].currentState = keyPressed;
-          keyStates[row][col].lastChangeTime = currentTime;
-          
-          // Add to buffer using helper function
-          addKeyChange(keyNumbers[row][col], keyPressed ? 1 : 0);
-          
-          debugPrintf("[KEY] %d %s (buffered: %d)", 
-                     keyNumbers[row][col],
-                     keyPressed ? "PRESSED" : "RELEASED",
-                     bufferCount);
-        }
+      uint16_t mask = (uint16_t)1 << col;
+      bool keyPressed = !(keyCurrent[row] & mask);
+      
+      keyCurrent[row] ^= mask;
+      
+      uint8_t keyIndex = row * MATRIX_COLS + col;
+      keyDebounce[row][col] = debounceWindow[keyIndex];
+      debounceEdge(keyIndex);
+      
+      if (keyPressed) {
+        holdKeyPressed(keyIndex);
+      } else if (!holdKeyReleased(keyIndex)) {
+        continue;  // Its release was sent when it was masked
       }
+      
+      // Stamped with the time its row was sampled, not when it is queued
+      pendingEdgeTime = rowSampleTime;
+      edgeInProgress = true;
+      processKeyEdge(keyIndex, keyPressed);
+      edgeInProgress = false;
+      
+      debugPrintf("[KEY] %d %S (buffered: %d)", 
+                 keyNumberForIndex(row * MATRIX_COLS + col),
+                 keyPressed ? PSTR("PRESSED") : PSTR("RELEASED"),
+                 bufferCount);
     }
   }
   
@@ -150,18 +582,207 @@ void scanMatrix() {
   for (int r = 0; r < MATRIX_ROWS; r++) {
     digitalWrite(rowPins[r], HIGH);
   }
+  
+  updateAutoRepeat();
+  updateChords();
+  updateGestures();
+}
+
+// Drive one row LOW and read its columns, bit n = column n, 1 = pressed.
+// The row stays LOW until the next row is selected.
+uint16_t readRow(uint8_t row) {
+  // Set only current row LOW
+  for (uint8_t r = 0; r < MATRIX_ROWS; r++) {
+    digitalWrite(rowPins[r], (r == row) ? LOW : HIGH);
+  }
+  
+  delayMicroseconds(10);
+  
+  uint16_t levels = readColumns();
+  rowSampleTime = edgeClockMicros();
+  
+  // A noise spike in one of three back-to-back reads is outvoted, so it
+  // never starts a debounce lockout
+  if (majorityVote) {
+    uint16_t second = readColumns();
+    uint16_t third = readColumns();
+    levels = (levels & second) | (levels & third) | (second & third);
+  }
+  
+  return levels;
+}
+
+// Read all 10 columns in one go, bit n = column n, 1 = pressed (pulled LOW).
+// Column pins 2-7 are PD2-PD7, 8-9 are PB0-PB1 and 11-12 are PB3-PB4.
+uint16_t readColumns() {
+  uint8_t pd = PIND;
+  uint8_t pb = PINB;
+  uint16_t levels = (uint16_t)(pd >> 2)                   // Cols 0-5
+                  | ((uint16_t)(pb & 0x03) << 6)          // Cols 6-7
+                  | ((uint16_t)((pb >> 3) & 0x03) << 8);  // Cols 8-9
+  return ~levels & ((1 << MATRIX_COLS) - 1);
+}
+
+// === KEY EDGE PIPELINE ===
+
+// A debounced edge (or the release of a masked stuck key) through layers,
+// chords and gestures into the queue
+void processKeyEdge(uint8_t keyIndex, bool keyPressed) {
+  uint8_t row = keyIndex / MATRIX_COLS;
+  uint16_t mask = (uint16_t)1 << (keyIndex % MATRIX_COLS);
+  
+  if (!layerKeyEdge(keyIndex, keyPressed)) {
+    return;  // Layer modifiers only switch layers
+  }
+  if (!(keyEventMask[row] & mask)) {
+    return;  // Tracked for snapshots only
+  }
+  if (chordKeyEdge(keyIndex, keyPressed) && gestureKeyEdge(keyIndex, keyPressed)) {
+    if (keyPressed) {
+      addKeyChange(keyIndex, KEY_EVENT_PRESSED);
+    } else if (holdReporting) {
+      addKeyChange(keyIndex, KEY_EVENT_RELEASED_HOLD, getHoldTime(keyIndex));
+    } else {
+      addKeyChange(keyIndex, KEY_EVENT_RELEASED);
+    }
+  }
+  if (!keyPressed) {
+    trackRepeatKey(keyIndex, false);
+  }
+}
+
+// Count every key's lockout down by the time since the previous scan
+void updateDebounceTimers(uint8_t elapsed) {
+  if (elapsed == 0) {
+    return;
+  }
+  
+  // Flat index is the key index
+  uint8_t* timer = &keyDebounce[0][0];
+  for (uint8_t i = 0; i < MATRIX_ROWS * MATRIX_COLS; i++, timer++) {
+    if (*timer == 0) {
+      continue;
+    }
+    if (*timer > elapsed) {
+      *timer -= elapsed;
+    } else {
+      *timer = 0;
+      debounceSettled(i);
+    }
+  }
 }
 
 // === I2C DATA TRANSMISSION ===
 void sendKeyboardData() {
+  buildFrame();
+  Wire.write(frameBuffer, frameLength);
+}
+
+// === FRAME ASSEMBLY ===
+// Frames are built in RAM so every transport sends the same bytes
+
+void frameWrite(uint8_t value) {
+  if (frameLength < FRAME_MAX_LENGTH) {
+    frameBuffer[frameLength++] = value;
+  }
+}
+
+void frameWriteBytes(const uint8_t* data, uint8_t length) {
+  for (uint8_t i = 0; i < length; i++) {
+    frameWrite(data[i]);
+  }
+}
+
+// Build the frame for the next read into frameBuffer
+void buildFrame() {
+  // frameBuffer still holds the last frame sent, changes in it are already
+  // off the buffer so this is the only way to get them again
+  if (retransmitPending) {
+    retransmitPending = false;
+    debugPrint("[I2C] Retransmitting last frame");
+    return;
+  }
+  
+  frameLength = 0;
+  
+  // Key states are not valid before the first scan, requested frames wait
+  if (!keyboardReady) {
+    frameWrite(DATA_TYPE_KEYPRESS);
+    frameWrite(0);
+    return;
+  }
+  
+  // A preceding command may have asked for a different frame, once
+  if (pendingResponse != DATA_TYPE_KEYPRESS) {
+    uint8_t response = pendingResponse;
+    pendingResponse = DATA_TYPE_KEYPRESS;
+    
+    if (response == DATA_TYPE_KEYMAP) {
+      buildKeymapFrame();
+      return;
+    }
+    if (response == DATA_TYPE_STATUS) {
+      buildStatusFrame();
+      return;
+    }
+    if (response == DATA_TYPE_SNAPSHOT) {
+      buildSnapshotFrame();
+      return;
+    }
+    if (response == DATA_TYPE_HISTORY) {
+      buildHistoryFrame();
+      return;
+    }
+    if (response == DATA_TYPE_FAULTS) {
+      buildFaultFrame();
+      return;
+    }
+  }
+  
+  if (initialStatePending) {
+    initialStatePending = false;
+    buildInitialStateFrame();
+    return;
+  }
+  
+#ifdef ANALOG_INPUT
+  // Key changes go first, analog values are sent when no keys are waiting
+  if (analogChangePending() && !(getBufferedChangeCount() > 0 && changesReady())) {
+    buildAnalogFrame();
+    return;
+  }
+#endif
+  
+  buildKeypressFrame();
+}
+
+void buildKeypressFrame() {
   // Send keypress type 
-  Wire.write(DATA_TYPE_KEYPRESS);  
+  bool sequenced = sequencedFrames;
+  frameTimed = timestampedFrames;
+  frameWrite((sequenced ? DATA_TYPE_KEYPRESS_SEQ : DATA_TYPE_KEYPRESS) | (frameTimed ? DATA_TYPE_TIMED : 0));  
+  if (sequenced) {
+    frameWrite(historyNextSeq);  // Sequence number of the first change
+  }
+  if (frameTimed) {
+    writeFrameClock();
+  }
   
-  uint8_t changesAvailable = getBufferedChangeCount();
+  uint8_t changesAvailable = changesReady() ? getBufferedChangeCount() : 0;
+  
+  // Only as many changes as fit in one frame, the rest wait for the next one
+  uint8_t space = FRAME_MAX_LENGTH - (sequenced ? 3 : 2) - (frameTimed ? FRAME_CLOCK_SIZE : 0);
+  for (uint8_t i = 0; i < changesAvailable; i++) {
+    uint8_t size = recordSize(peekChange(i));
+    if (size > space) {
+      changesAvailable = i;
+      break;
+    }
+    space -= size;
+  }
   
   if (changesAvailable > 0) {
-    // Send up to all available changes (the buffer is small)
-    Wire.write(changesAvailable);  
+    frameWrite(changesAvailable);  
     
     debugPrintf("[I2C] Sending %d key changes", changesAvailable);
     
@@ -169,50 +790,638 @@ void sendKeyboardData() {
     for (uint8_t i = 0; i < changesAvailable; i++) {
       KeyChange change;
       if (getNextChange(&change)) {
-        Wire.write((change.keyNumber >> 8) & 0xFF);  // High byte
-        Wire.write(change.keyNumber & 0xFF);         // Low byte  
-        Wire.write(change.newState);                 // State
-        
-        debugPrintf("  Key %d -> %s", 
-                   change.keyNumber,
-                   change.newState ? "PRESSED" : "RELEASED");
+        writeRecord(&change);
+        addToHistory(&change);
       }
     }
     
     debugPrintf("[I2C] Sent %d changes, %d remaining in buffer", 
-               changesAvailable, bufferCount);
+               changesAvailable, getBufferedChangeCount());
   } else {
     // No changes to send
-    Wire.write(0);  // Count: 0 changes
+    frameWrite(0);  // Count: 0 changes
     debugPrint("[I2C] No changes to send");
   }
 }
 
+// False while the normal buffer is inside a coalescing hold-off
+bool changesReady() {
+  if (coalesceHoldoff == 0 || priorityCount > 0 || bufferCount == 0) {
+    return true;
+  }
+  
+  uint16_t currentTick = (uint16_t)millis();
+  return (uint16_t)(currentTick - lastQueuedTick) >= COALESCE_SETTLE_MS ||
+         (uint16_t)(currentTick - firstPendingTick) >= coalesceHoldoff;
+}
+
+uint8_t recordSize(const KeyChange* change) {
+  uint8_t size = KEYPRESS_RECORD_SIZE;
+  
+  if (change->event == KEY_EVENT_CHORD) {
+    size = CHORD_RECORD_SIZE;
+  } else if (change->event == KEY_EVENT_RELEASED_HOLD) {
+    size = HOLD_RECORD_SIZE;
+  } else if (change->event == KEY_EVENT_ENCODER) {
+    size = ENCODER_RECORD_SIZE;
+  }
+  return frameTimed ? size + EDGE_TIME_SIZE : size;
+}
+
+void writeRecord(const KeyChange* change) {
+  writeRecordFields(change);
+  
+  if (frameTimed) {
+    // Only the age fits in 16 bits, older records say "at least 65.5ms"
+    uint32_t age = frameClock - change->edgeTime;
+    uint16_t edgeTime = (uint16_t)frameClock - (uint16_t)((age > EDGE_AGE_MAX) ? EDGE_AGE_MAX : age);
+    frameWrite((edgeTime >> 8) & 0xFF);
+    frameWrite(edgeTime & 0xFF);
+  }
+}
+
+void writeRecordFields(const KeyChange* change) {
+  if (change->event == KEY_EVENT_CHORD) {
+    uint8_t keys[CHORD_MASK_BYTES];
+    getChordKeys(change->keyIndex, keys);
+    
+    frameWrite(0);                        // No single key number
+    frameWrite(0);
+    frameWrite(change->event);
+    frameWriteBytes(keys, CHORD_MASK_BYTES);  // Bit n = matrix index n, byte 0 first
+    
+    debugPrint("  Chord");
+    return;
+  }
+  
+  if (change->event == KEY_EVENT_ENCODER) {
+    frameWrite(0);
+    frameWrite(change->keyIndex);
+    frameWrite(change->event);
+    frameWrite((change->value >> 8) & 0xFF);
+    frameWrite(change->value & 0xFF);
+    
+    debugPrintf("  Encoder %d -> %d", change->keyIndex, (int16_t)change->value);
+    return;
+  }
+  
+  uint16_t keyNumber = keyNumberForIndex(change->keyIndex);
+  
+  frameWrite((keyNumber >> 8) & 0xFF);  // High byte
+  frameWrite(keyNumber & 0xFF);         // Low byte  
+  frameWrite(change->event);            // State
+  
+  if (change->event == KEY_EVENT_RELEASED_HOLD) {
+    frameWrite((change->value >> 8) & 0xFF);
+    frameWrite(change->value & 0xFF);
+  }
+  
+  debugPrintf("  Key %d -> %d", keyNumber, change->event);
+}
+
+void buildKeymapFrame() {
+  uint8_t layer = keymapReadStart >> KEY_LAYER_SHIFT;
+  uint8_t start = keymapReadStart & KEY_INDEX_MASK;
+  uint8_t count = 0;
+  
+  if (layer < KEYMAP_LAYERS && start < MATRIX_KEYS) {
+    count = MATRIX_KEYS - start;
+    if (count > MAX_KEYMAP_ENTRIES_PER_FRAME) {
+      count = MAX_KEYMAP_ENTRIES_PER_FRAME;
+    }
+  }
+  
+  frameWrite(DATA_TYPE_KEYMAP);
+  frameWrite(keymapReadStart);
+  frameWrite(count);
+  
+  for (uint8_t i = 0; i < count; i++) {
+    frameWrite((keymap[layer][start + i] >> 8) & 0xFF);
+    frameWrite(keymap[layer][start + i] & 0xFF);
+  }
+}
+
+// Status frame: stack low-water mark, stack region size, dropped change
+// counters, ready flag, boot-to-ready time
+void buildStatusFrame() {
+  uint16_t stackFree = getStackFreeLowWater();
+  uint16_t stackSize = getStackRegionSize();
+  
+  frameWrite(DATA_TYPE_STATUS);
+  frameWrite((stackFree >> 8) & 0xFF);
+  frameWrite(stackFree & 0xFF);
+  frameWrite((stackSize >> 8) & 0xFF);
+  frameWrite(stackSize & 0xFF);
+  frameWrite(overflowCount);
+  frameWrite(staleCount);
+  frameWrite(keyboardReady ? 1 : 0);
+  frameWrite((bootReadyMicros >> 8) & 0xFF);
+  frameWrite(bootReadyMicros & 0xFF);
+}
+
+// Snapshot frame: debounced state bitmap per row, high/low byte, row 0 first
+void buildSnapshotFrame() {
+  frameWrite(DATA_TYPE_SNAPSHOT);
+  
+  for (uint8_t row = 0; row < MATRIX_ROWS; row++) {
+    frameWrite((keyCurrent[row] >> 8) & 0xFF);
+    frameWrite(keyCurrent[row] & 0xFF);
+  }
+}
+
+// Initial state frame: boot epoch high/low, then the pressed bitmap of each
+// row as taken at boot (or since, if the first read comes later)
+void buildInitialStateFrame() {
+  frameWrite(DATA_TYPE_INITIAL_STATE);
+  frameWrite((bootEpoch >> 8) & 0xFF);
+  frameWrite(bootEpoch & 0xFF);
+  
+  for (uint8_t row = 0; row < MATRIX_ROWS; row++) {
+    frameWrite((keyCurrent[row] >> 8) & 0xFF);
+    frameWrite(keyCurrent[row] & 0xFF);
+  }
+}
+
+// Fault frame: faulty rows, faulty columns high/low, then the keys closed
+// during the self-test as a bitmap per row
+void buildFaultFrame() {
+  frameWrite(DATA_TYPE_FAULTS);
+  frameWrite(rowFaults);
+  frameWrite((columnFaults >> 8) & 0xFF);
+  frameWrite(columnFaults & 0xFF);
+  
+  for (uint8_t row = 0; row < MATRIX_ROWS; row++) {
+    frameWrite((closedAtTest[row] >> 8) & 0xFF);
+    frameWrite(closedAtTest[row] & 0xFF);
+  }
+}
+
+#ifdef ANALOG_INPUT
+// Analog frame: A6 then A7 as 12-bit values, high byte first
+void buildAnalogFrame() {
+  frameWrite(DATA_TYPE_ANALOG);
+  
+  for (uint8_t channel = 0; channel < ANALOG_CHANNELS; channel++) {
+    uint16_t value = getAnalogValue(channel);
+    frameWrite((value >> 8) & 0xFF);
+    frameWrite(value & 0xFF);
+  }
+  clearAnalogChange();
+}
+#endif
+
+// History frame: same layout as DATA_TYPE_KEYPRESS_SEQ. If the first sequence
+// number is not N + 1 the changes in between are no longer in the history.
+void buildHistoryFrame() {
+  uint8_t oldestSeq = historyNextSeq - historyCount;
+  uint8_t startSeq = historyQuerySeq + 1;
+  
+  // Anything not between the oldest kept and the next sequence is gone
+  if ((uint8_t)(startSeq - oldestSeq) > historyCount) {
+    startSeq = oldestSeq;
+  }
+  
+  uint8_t available = historyNextSeq - startSeq;
+  uint8_t first = (uint8_t)(historyCount - available);  // Offset from the oldest entry
+  uint8_t oldestSlot = (uint8_t)(historyNextSeq - historyCount) & (HISTORY_SIZE - 1);
+  frameTimed = timestampedFrames;
+  uint8_t space = FRAME_MAX_LENGTH - 3 - (frameTimed ? FRAME_CLOCK_SIZE : 0);
+  uint8_t count = 0;
+  
+  while (count < available) {
+    const KeyChange* change = &historyBuffer[(oldestSlot + first + count) & (HISTORY_SIZE - 1)];
+    uint8_t size = recordSize(change);
+    if (size > space) {
+      break;
+    }
+    space -= size;
+    count++;
+  }
+  
+  frameWrite(DATA_TYPE_HISTORY | (frameTimed ? DATA_TYPE_TIMED : 0));
+  frameWrite(startSeq);
+  if (frameTimed) {
+    writeFrameClock();
+  }
+  frameWrite(count);
+  
+  for (uint8_t i = 0; i < count; i++) {
+    writeRecord(&historyBuffer[(oldestSlot + first + i) & (HISTORY_SIZE - 1)]);
+  }
+}
+
+// Edge clock now, so the master can place the records' 16-bit edge times
+void writeFrameClock() {
+  frameClock = edgeClockMicros();
+  frameWrite((frameClock >> 24) & 0xFF);
+  frameWrite((frameClock >> 16) & 0xFF);
+  frameWrite((frameClock >> 8) & 0xFF);
+  frameWrite(frameClock & 0xFF);
+}
+
+// Priority and history records can be kept for hours, pin the ones past
+// EDGE_AGE_MAX just beyond it so the 32-bit clock never wraps back to them
+static void ageRecordEdgeTimes(KeyChange* changes, uint8_t count, uint32_t clock) {
+  for (uint8_t i = 0; i < count; i++) {
+    if (clock - changes[i].edgeTime > EDGE_AGE_MAX) {
+      changes[i].edgeTime = clock - EDGE_AGE_MAX - 1;
+    }
+  }
+}
+
+void ageEdgeTimes() {
+  noInterrupts();
+  uint32_t clock = edgeClockMicros();
+  ageRecordEdgeTimes(changeBuffer, CHANGE_BUFFER_SIZE, clock);
+  ageRecordEdgeTimes(priorityBuffer, PRIORITY_BUFFER_SIZE, clock);
+  ageRecordEdgeTimes(historyBuffer, HISTORY_SIZE, clock);
+  interrupts();
+}
+
+// A dropped change still uses up a sequence number so the master sees the
+// gap. The history before it cannot be sent as one run with what follows,
+// so it goes too. Called with interrupts off.
+void skipSequence() {
+  historyNextSeq++;
+  historyCount = 0;
+}
+
+void addToHistory(const KeyChange* change) {
+  historyBuffer[historyNextSeq & (HISTORY_SIZE - 1)] = *change;
+  historyNextSeq++;
+  if (historyCount < HISTORY_SIZE) {
+    historyCount++;
+  }
+}
+
+// === I2C COMMAND HANDLING ===
+void receiveCommand(int byteCount) {
+  uint8_t data[BUFFER_LENGTH];
+  uint8_t length = 0;
+  
+  while (Wire.available() && length < byteCount && length < sizeof(data)) {
+    data[length++] = Wire.read();
+  }
+  
+  handleCommand(data, length);
+}
+
+// === UART TRANSPORT ===
+// Handles at most one command per loop and pushes a frame whenever a
+// response or changes are waiting and the TX ring has room for it
+void serviceUartTransport() {
+  uint8_t command[UART_MAX_PAYLOAD];
+  uint8_t length;
+  
+  if (uartReceiveCommand(command, &length)) {
+    handleCommand(command, length);
+  }
+  
+  if (!uartCanSend(FRAME_MAX_LENGTH)) {
+    return;
+  }
+  
+  bool analogReady = false;
+#ifdef ANALOG_INPUT
+  analogReady = analogChangePending();
+#endif
+  
+  if (retransmitPending || pendingResponse != DATA_TYPE_KEYPRESS || initialStatePending ||
+      analogReady || (getBufferedChangeCount() > 0 && changesReady())) {
+    buildFrame();
+    uartSendFrame(frameBuffer, frameLength);
+  }
+}
+
+// === COMMAND PROCESSING ===
+// Commands arrive as a command byte followed by arguments, from any transport
+
+int commandAvailable() {
+  return commandLength - commandPos;
+}
+
+// Next argument byte, -1 once the command is used up (like Wire.read())
+int commandRead() {
+  return (commandPos < commandLength) ? commandData[commandPos++] : -1;
+}
+
+void handleCommand(const uint8_t* data, uint8_t length) {
+  if (length < 1) {
+    return;
+  }
+  
+  commandData = data;
+  commandLength = length;
+  commandPos = 0;
+  
+  uint8_t command = commandRead();
+  
+  switch (command) {
+    case CMD_KEYMAP_WRITE: {
+      uint8_t start = commandRead();
+      uint8_t layer = start >> KEY_LAYER_SHIFT;
+      uint8_t index = start & KEY_INDEX_MASK;
+      while (commandAvailable() >= 2 && layer < KEYMAP_LAYERS && index < MATRIX_KEYS) {
+        uint16_t keyNumber = (uint16_t)commandRead() << 8;
+        keyNumber |= commandRead();
+        keymap[layer][index++] = keyNumber;
+      }
+      break;
+    }
+    
+    case CMD_KEYMAP_READ:
+      keymapReadStart = commandAvailable() ? commandRead() : 0;
+      pendingResponse = DATA_TYPE_KEYMAP;
+      break;
+    
+    case CMD_CONFIG_SAVE:
+      saveConfig(&settingsStore);
+      break;
+    
+    case CMD_KEYMAP_RESET:
+      resetKeymap();
+      break;
+    
+    case CMD_I2C_ADDRESS:
+      if (commandAvailable()) {
+        uint8_t address = commandRead();
+        if (address >= I2C_ADDRESS_MIN && address <= I2C_ADDRESS_MAX) {
+          i2cAddress = address;
+        }
+      }
+      break;
+    
+    case CMD_DEBOUNCE:
+      if (commandAvailable()) {
+        uint8_t minWindow = commandRead();
+        uint8_t maxWindow = commandAvailable() ? commandRead() : minWindow;
+        if (minWindow != 0 && minWindow <= maxWindow) {
+          setDebounceBounds(minWindow, maxWindow);
+        }
+      }
+      break;
+    
+    case CMD_SCAN_INTERVAL:
+      if (commandAvailable()) {
+        uint8_t interval = commandRead();
+        scanIntervalMs = (interval > SCAN_INTERVAL_MAX_MS) ? SCAN_INTERVAL_MAX_MS : interval;
+      }
+      break;
+    
+    case CMD_MAJORITY_VOTE:
+      if (commandAvailable()) {
+        majorityVote = commandRead() != 0;
+      }
+      break;
+    
+    case CMD_STATUS_READ:
+      pendingResponse = DATA_TYPE_STATUS;
+      break;
+    
+    case CMD_SNAPSHOT_READ:
+      pendingResponse = DATA_TYPE_SNAPSHOT;
+      break;
+    
+    case CMD_HISTORY_READ:
+      if (commandAvailable()) {
+        historyQuerySeq = commandRead();
+        pendingResponse = DATA_TYPE_HISTORY;
+      }
+      break;
+    
+    case CMD_RETRANSMIT:
+      retransmitPending = true;
+      break;
+    
+    case CMD_SELF_TEST:
+      selfTestPending = true;   // Pins are switched around, so it runs from the loop
+      break;
+    
+    case CMD_FAULT_READ:
+      pendingResponse = DATA_TYPE_FAULTS;
+      break;
+    
+    case CMD_REPEAT_CONFIG:
+      if (commandAvailable() >= 4) {
+        uint16_t delayMs = (uint16_t)commandRead() << 8;
+        delayMs |= commandRead();
+        uint16_t intervalMs = (uint16_t)commandRead() << 8;
+        intervalMs |= commandRead();
+        setRepeatTiming(delayMs, intervalMs);
+      }
+      break;
+    
+    case CMD_REPEAT_MASK:
+      readRowMasks(repeatMask);
+      break;
+    
+    case CMD_GESTURE_MASK:
+      readRowMasks(gestureMask);
+      break;
+    
+    case CMD_GESTURE_MODE:
+      if (commandAvailable()) {
+        gestureMode = (commandRead() == GESTURE_MODE_INSTEAD) ? GESTURE_MODE_INSTEAD : GESTURE_MODE_ALONGSIDE;
+      }
+      break;
+    
+    case CMD_GESTURE_TIMING: {
+      uint8_t index = commandRead();
+      while (commandAvailable() >= 3 && index < MATRIX_KEYS) {
+        gestureTapMax[index] = commandRead();
+        gestureDoubleGap[index] = commandRead();
+        gestureLongPress[index] = commandRead();
+        index++;
+      }
+      break;
+    }
+    
+    case CMD_CHORD_MASK:
+      readRowMasks(chordMask);
+      break;
+    
+    case CMD_CHORD_WINDOW:
+      if (commandAvailable()) {
+        chordWindow = commandRead();
+      }
+      break;
+    
+    case CMD_HOLD_REPORT:
+      if (commandAvailable()) {
+        holdReporting = (commandRead() != 0);
+      }
+      break;
+    
+    case CMD_ENABLE_MASK:
+      readRowMasks(keyEnableMask);
+      break;
+    
+    case CMD_EVENT_MASK:
+      readRowMasks(keyEventMask);
+      break;
+    
+    case CMD_PRIORITY_MASK:
+      readRowMasks(priorityMask);
+      break;
+    
+    case CMD_SEQUENCE_MODE:
+      if (commandAvailable()) {
+        sequencedFrames = (commandRead() != 0);
+      }
+      break;
+    
+    case CMD_TIMESTAMPS:
+      if (commandAvailable()) {
+        timestampedFrames = (commandRead() != 0);
+      }
+      break;
+    
+    case CMD_STUCK_KEY:
+      if (commandAvailable() >= 2) {
+        uint8_t limit = commandRead();
+        stuckLimit = (limit > STUCK_LIMIT_MAX_S) ? STUCK_LIMIT_MAX_S : limit;
+        stuckMasking = commandRead() != 0;
+      }
+      break;
+    
+    case CMD_COALESCE:
+      if (commandAvailable()) {
+        uint8_t holdoff = commandRead();
+        coalesceHoldoff = (holdoff > COALESCE_MAX_MS) ? COALESCE_MAX_MS : holdoff;
+      }
+      break;
+    
+    case CMD_LAYER_KEY:
+      if (commandAvailable() >= 4) {
+        uint8_t slot = commandRead();
+        uint8_t keyIndex = commandRead();
+        uint8_t mode = commandRead();
+        uint8_t layer = commandRead();
+        if (!setLayerModifier(slot, keyIndex, mode, layer)) {
+          debugPrint("[CMD] Invalid layer key");
+        }
+      }
+      break;
+    
+    default:
+      debugPrintf("[CMD] Unknown command 0x%02X", command);
+      break;
+  }
+}
+
+// Row bitmaps as sent by the master: high/low byte per row, bit n = column n.
+// Rows not included in the write keep their previous mask.
+void readRowMasks(uint16_t* masks) {
+  for (uint8_t row = 0; row < MATRIX_ROWS && commandAvailable() >= 2; row++) {
+    uint16_t mask = (uint16_t)commandRead() << 8;
+    mask |= commandRead();
+    masks[row] = mask & ((1 << MATRIX_COLS) - 1);
+  }
+}
+
 // === CIRCULAR BUFFER HELPER FUNCTIONS ===
+// The buffer is drained from the TWI interrupt, so the loop side updates
+// the pointers with interrupts disabled.
+
+uint32_t keyEventTime() {
+  return edgeInProgress ? pendingEdgeTime : edgeClockMicros();
+}
+
+void addKeyChange(uint8_t keyIndex, uint8_t event, uint16_t value) {
+  addKeyChangeAt(keyIndex, event, keyEventTime(), value);
+}
 
-void addKeyChange(uint16_t keyNumber, uint8_t newState) {
-  // Add change to circular buffer
-  changeBuffer[bufferHead].keyNumber = keyNumber;
-  changeBuffer[bufferHead].newState = newState;
-  changeBuffer[bufferHead].timestamp = millis();
+void addKeyChangeAt(uint8_t keyIndex, uint8_t event, uint32_t edgeTime, uint16_t value) {
+  bool priority = false;
+  
+  // Repeat starts from the press actually sent, a chord may have held it back
+  if (event == KEY_EVENT_PRESSED) {
+    trackRepeatKey(keyIndex, true);
+  }
+  
+  // Tag keys with the layer they went down on, chord slots and encoders have no layer
+  if (event != KEY_EVENT_CHORD && event != KEY_EVENT_ENCODER) {
+    priority = (priorityMask[keyIndex / MATRIX_COLS] & ((uint16_t)1 << (keyIndex % MATRIX_COLS))) != 0;
+    keyIndex |= getKeyLayer(keyIndex) << KEY_LAYER_SHIFT;
+  }
+  
+  KeyChange change;
+  change.keyIndex = keyIndex;
+  change.event = event;
+  change.value = value;
+  change.tick = (uint16_t)millis();
+  change.edgeTime = edgeTime;
+  bool overwritten = false;
+  
+  noInterrupts();
+  
+  // Further turns while the last encoder record is still queued are added
+  // to it, so spinning the encoder uses one record instead of many
+  if (event == KEY_EVENT_ENCODER && bufferCount > 0) {
+    KeyChange* newest = &changeBuffer[(bufferHead - 1) & (CHANGE_BUFFER_SIZE - 1)];
+    if (newest->event == KEY_EVENT_ENCODER && newest->keyIndex == keyIndex) {
+      newest->value += value;
+      interrupts();
+      return;
+    }
+  }
+  
+  if (priority && priorityCount < PRIORITY_BUFFER_SIZE) {
+    priorityBuffer[priorityHead] = change;
+    priorityHead = (priorityHead + 1) & (PRIORITY_BUFFER_SIZE - 1);
+    priorityCount++;
+    interrupts();
+    return;
+  }
+  
+  if (bufferCount == 0) {
+    firstPendingTick = change.tick;
+  }
+  lastQueuedTick = change.tick;
+  changeBuffer[bufferHead] = change;
   
   // Move head pointer
-  bufferHead = (bufferHead + 1) % CHANGE_BUFFER_SIZE;
+  bufferHead = (bufferHead + 1) & (CHANGE_BUFFER_SIZE - 1);
   
   // If buffer is full, advance tail (overwrite oldest)
   if (bufferCount >= CHANGE_BUFFER_SIZE) {
-    bufferTail = (bufferTail + 1) % CHANGE_BUFFER_SIZE;
-    debugPrint("[BUFFER] Buffer full - overwriting oldest change");
+    bufferTail = (bufferTail + 1) & (CHANGE_BUFFER_SIZE - 1);
+    overwritten = true;
+    skipSequence();
+    if (overflowCount < 255) {
+      overflowCount++;
+    }
   } else {
     bufferCount++;
   }
+  interrupts();
+  
+  if (overwritten) {
+    debugPrint("[BUFFER] Buffer full - overwriting oldest change");
+  }
 }
 
 uint8_t getBufferedChangeCount() {
-  return bufferCount;
+  return priorityCount + bufferCount;
+}
+
+// Changes in sending order without removing them, priority buffer first
+const KeyChange* peekChange(uint8_t position) {
+  if (position < priorityCount) {
+    return &priorityBuffer[(priorityTail + position) & (PRIORITY_BUFFER_SIZE - 1)];
+  }
+  position -= priorityCount;
+  return &changeBuffer[(bufferTail + position) & (CHANGE_BUFFER_SIZE - 1)];
 }
 
 bool getNextChange(KeyChange* change) {
+  if (priorityCount > 0) {
+    *change = priorityBuffer[priorityTail];
+    priorityTail = (priorityTail + 1) & (PRIORITY_BUFFER_SIZE - 1);
+    priorityCount--;
+    return true;
+  }
+  
   if (bufferCount == 0) {
     return false;  // No changes available
   }
@@ -221,23 +1430,39 @@ bool getNextChange(KeyChange* change) {
   *change = changeBuffer[bufferTail];
   
   // Move tail pointer and decrease count
-  bufferTail = (bufferTail + 1) % CHANGE_BUFFER_SIZE;
+  bufferTail = (bufferTail + 1) & (CHANGE_BUFFER_SIZE - 1);
   bufferCount--;
   
   return true;
 }
 
 void clearStaleChanges() {
-  unsigned long currentTime = millis();
+  uint16_t currentTick = (uint16_t)millis();
   
-  // Check if oldest change is too old (100ms timeout)
-  while (bufferCount > 0) {
-    if ((currentTime - changeBuffer[bufferTail].timestamp) > 100) {
-      debugPrint("[TIMEOUT] Clearing stale change from buffer");
-      bufferTail = (bufferTail + 1) % CHANGE_BUFFER_SIZE;
+  // Check if oldest change is too old (the priority buffer never expires)
+  while (true) {
+    bool cleared = false;
+    
+    noInterrupts();
+    if (bufferCount > 0 && (uint16_t)(currentTick - changeBuffer[bufferTail].tick) > STALE_CHANGE_MS) {
+      bufferTail = (bufferTail + 1) & (CHANGE_BUFFER_SIZE - 1);
       bufferCount--;
-    } else {
-      break;  // Oldest change is still fresh
+      cleared = true;
+      skipSequence();
+      if (staleCount < 255) {
+        staleCount++;
+      }
     }
+    interrupts();
+    
+    if (!cleared) {
+      break;  // Buffer empty or oldest change is still fresh
+    }
+    debugPrint("[TIMEOUT] Clearing stale change from buffer");
   }
-}
\ No newline at end of file
+}
+
+// Translate a layer-tagged matrix index back to the 101-410 key numbering
+uint16_t keyNumberForIndex(uint8_t keyIndex) {
+  return keymapLookup(keyIndex >> KEY_LAYER_SHIFT, keyIndex & KEY_INDEX_MASK);
+}